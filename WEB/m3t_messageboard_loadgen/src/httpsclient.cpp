@@ -0,0 +1,253 @@
+#include "httpsclient.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+
+#include <cstdlib>
+#include <strings.h>
+
+HTTPSClient::HTTPSClient(SSL_CTX *ctx, const std::string &host, uint16_t port, const std::string &hostHeader)
+    : m_ctx(ctx)
+    , m_host(host)
+    , m_port(port)
+    , m_hostHeader(hostHeader)
+{}
+
+HTTPSClient::~HTTPSClient()
+{
+    disconnect();
+}
+
+bool HTTPSClient::fail(const std::string &error)
+{
+    m_error = error;
+    disconnect();
+    return false;
+}
+
+bool HTTPSClient::connect()
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(m_host.c_str(), std::to_string(m_port).c_str(), &hints, &addresses) != 0 || !addresses)
+        return fail("Failed to resolve " + m_host);
+
+    for (addrinfo *ai = addresses; ai && m_fd < 0; ai = ai->ai_next)
+    {
+        m_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (m_fd >= 0 && ::connect(m_fd, ai->ai_addr, ai->ai_addrlen) != 0)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+
+    if (m_fd < 0)
+        return fail("Failed to connect to " + m_host + ":" + std::to_string(m_port));
+
+    int noDelay = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    m_ssl = SSL_new(m_ctx);
+    SSL_set_fd(m_ssl, m_fd);
+    SSL_set_tlsext_host_name(m_ssl, m_hostHeader.c_str());
+    if (SSL_connect(m_ssl) != 1)
+    {
+        char error[256];
+        ERR_error_string_n(ERR_get_error(), error, sizeof(error));
+        return fail(std::string("TLS handshake failed: ") + error);
+    }
+
+    m_buffer.clear();
+    m_bufferPos = 0;
+    m_connections++;
+    return true;
+}
+
+void HTTPSClient::disconnect()
+{
+    if (m_ssl)
+    {
+        SSL_shutdown(m_ssl);
+        SSL_free(m_ssl);
+        m_ssl = nullptr;
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool HTTPSClient::writeAll(const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        int n = SSL_write(m_ssl, data.data() + sent, static_cast<int>(data.size() - sent));
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool HTTPSClient::fill()
+{
+    // Drop what was already consumed before reading more.
+    if (m_bufferPos)
+    {
+        m_buffer.erase(0, m_bufferPos);
+        m_bufferPos = 0;
+    }
+
+    char chunk[16384];
+    int n = SSL_read(m_ssl, chunk, sizeof(chunk));
+    if (n <= 0)
+        return false;
+    m_buffer.append(chunk, static_cast<size_t>(n));
+    return true;
+}
+
+bool HTTPSClient::readLine(std::string &line)
+{
+    for (;;)
+    {
+        size_t end = m_buffer.find("\r\n", m_bufferPos);
+        if (end != std::string::npos)
+        {
+            line = m_buffer.substr(m_bufferPos, end - m_bufferPos);
+            m_bufferPos = end + 2;
+            return true;
+        }
+        if (!fill())
+            return false;
+    }
+}
+
+bool HTTPSClient::readBytes(size_t len, std::string &out)
+{
+    while (m_buffer.size() - m_bufferPos < len)
+    {
+        if (!fill())
+            return false;
+    }
+    out.append(m_buffer, m_bufferPos, len);
+    m_bufferPos += len;
+    return true;
+}
+
+bool HTTPSClient::readResponse(Response &response, bool &keepAlive)
+{
+    std::string line;
+    if (!readLine(line) || line.compare(0, 5, "HTTP/") != 0 || line.size() < 12)
+        return false;
+    response.status = atoi(line.c_str() + 9);
+    keepAlive = line.compare(0, 8, "HTTP/1.1") == 0;
+
+    bool chunked = false;
+    bool hasLength = false;
+    size_t contentLength = 0;
+    for (;;)
+    {
+        if (!readLine(line))
+            return false;
+        if (line.empty())
+            break;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+        std::string name = line.substr(0, colon);
+        size_t valueStart = line.find_first_not_of(' ', colon + 1);
+        std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+
+        if (strcasecmp(name.c_str(), "Content-Length") == 0)
+        {
+            hasLength = true;
+            contentLength = strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0)
+            chunked = strcasecmp(value.c_str(), "chunked") == 0;
+        else if (strcasecmp(name.c_str(), "Connection") == 0)
+            keepAlive = strcasecmp(value.c_str(), "close") != 0;
+    }
+
+    response.body.clear();
+    if (chunked)
+    {
+        for (;;)
+        {
+            if (!readLine(line))
+                return false;
+            size_t size = strtoull(line.c_str(), nullptr, 16);
+            if (size == 0)
+                break;
+            if (!readBytes(size, response.body) || !readLine(line))
+                return false;
+        }
+        // Trailers
+        while (readLine(line) && !line.empty())
+        {
+        }
+        return true;
+    }
+    if (hasLength)
+        return readBytes(contentLength, response.body);
+
+    if (response.status == 204 || response.status == 304)
+        return true;
+
+    // Body delimited by the end of the connection
+    keepAlive = false;
+    response.body.append(m_buffer, m_bufferPos, std::string::npos);
+    m_bufferPos = m_buffer.size();
+    while (fill())
+    {
+        response.body.append(m_buffer, m_bufferPos, std::string::npos);
+        m_bufferPos = m_buffer.size();
+    }
+    return true;
+}
+
+bool HTTPSClient::request(const std::string &method, const std::string &target, const std::string &body, const std::vector<std::string> &headers, Response &response)
+{
+    std::string request = method + " " + target + " HTTP/1.1\r\nHost: " + m_hostHeader + "\r\n";
+    for (const std::string &header : headers)
+        request += header + "\r\n";
+    if (!body.empty())
+        request += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+    request += "\r\n" + body;
+
+    // A kept-alive connection may have been closed by the server meanwhile: retry once on a new one,
+    // unless the request changes something (it may have been processed even if the response was lost).
+    bool idempotent = method == "GET" || method == "HEAD";
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        bool reused = m_ssl != nullptr;
+        if (!reused && !connect())
+            return false;
+
+        bool keepAlive = false;
+        if (writeAll(request) && readResponse(response, keepAlive))
+        {
+            if (!keepAlive)
+                disconnect();
+            return true;
+        }
+
+        disconnect();
+        if (!reused || !idempotent)
+            break;
+    }
+    return fail("Connection lost during " + method + " " + target);
+}
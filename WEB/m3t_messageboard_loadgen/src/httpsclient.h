@@ -0,0 +1,71 @@
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Minimal HTTP/1.1 client over a persistent TLS connection
+ *
+ * One instance per worker thread. The connection is kept alive between requests and
+ * reopened when the server closes it.
+ */
+class HTTPSClient
+{
+public:
+    struct Response
+    {
+        int status = 0;
+        std::string body;
+    };
+
+    /**
+     * @param ctx TLS context (shared by every client)
+     * @param host address to connect to
+     * @param hostHeader value of the Host header (also used for SNI)
+     */
+    HTTPSClient(SSL_CTX *ctx, const std::string &host, uint16_t port, const std::string &hostHeader);
+    HTTPSClient(const HTTPSClient &) = delete;
+    HTTPSClient &operator=(const HTTPSClient &) = delete;
+    ~HTTPSClient();
+
+    /**
+     * @brief Send a request and read the complete response
+     * @param headers extra header lines ("Name: value")
+     * @return false on connection or protocol error (error() describes it)
+     */
+    bool request(const std::string &method, const std::string &target, const std::string &body, const std::vector<std::string> &headers, Response &response);
+
+    const std::string &error() const { return m_error; }
+
+    /**
+     * @brief Connections opened so far (reconnections included)
+     */
+    uint64_t connections() const { return m_connections; }
+
+private:
+    bool connect();
+    void disconnect();
+    bool fail(const std::string &error);
+
+    bool writeAll(const std::string &data);
+    bool fill();
+    bool readLine(std::string &line);
+    bool readBytes(size_t len, std::string &out);
+    bool readResponse(Response &response, bool &keepAlive);
+
+    SSL_CTX *m_ctx;
+    std::string m_host;
+    uint16_t m_port;
+    std::string m_hostHeader;
+
+    int m_fd = -1;
+    SSL *m_ssl = nullptr;
+    std::string m_buffer;
+    size_t m_bufferPos = 0;
+
+    uint64_t m_connections = 0;
+    std::string m_error;
+};
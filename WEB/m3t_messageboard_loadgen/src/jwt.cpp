@@ -0,0 +1,55 @@
+#include "jwt.h"
+
+#include <json/writer.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include <ctime>
+
+static std::string base64URL(const unsigned char *data, size_t len)
+{
+    std::string out(4 * ((len + 2) / 3) + 1, '\0');
+    int n = EVP_EncodeBlock(reinterpret_cast<unsigned char *>(&out[0]), data, static_cast<int>(len));
+    out.resize(static_cast<size_t>(n));
+
+    // Unpadded base64url (RFC 7515)
+    while (!out.empty() && out.back() == '=')
+        out.pop_back();
+    for (char &c : out)
+    {
+        if (c == '+')
+            c = '-';
+        else if (c == '/')
+            c = '_';
+    }
+    return out;
+}
+
+static std::string base64URL(const std::string &data)
+{
+    return base64URL(reinterpret_cast<const unsigned char *>(data.data()), data.size());
+}
+
+std::string JWTIssuer::issue(Json::Value claims, uint32_t validSeconds) const
+{
+    Json::Int64 now = static_cast<Json::Int64>(time(nullptr));
+    if (!claims.isMember("iat"))
+        claims["iat"] = now;
+    if (!claims.isMember("exp"))
+        claims["exp"] = now + validSeconds;
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+
+    Json::Value header;
+    header["alg"] = "HS256";
+    header["typ"] = "JWT";
+
+    std::string signingInput = base64URL(Json::writeString(writer, header)) + "." + base64URL(Json::writeString(writer, claims));
+
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int macLen = 0;
+    HMAC(EVP_sha256(), m_secret.data(), static_cast<int>(m_secret.size()), reinterpret_cast<const unsigned char *>(signingInput.data()), signingInput.size(), mac, &macLen);
+
+    return signingInput + "." + base64URL(mac, macLen);
+}
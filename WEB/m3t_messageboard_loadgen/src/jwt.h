@@ -0,0 +1,30 @@
+#pragma once
+
+#include <json/value.h>
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Stand-in for the login server: issues HS256 access tokens signed with a shared secret
+ *
+ * The message board server must validate its tokens with the same secret (HS256) instead of
+ * getting its keys from the login server through APISync: set in the JWT settings of the
+ * RESTful engine (WebService.JWT of its webserver.conf).
+ */
+class JWTIssuer
+{
+public:
+    explicit JWTIssuer(const std::string &secret)
+        : m_secret(secret)
+    {}
+
+    /**
+     * @brief Signed token with the given claims (iat/exp are added when missing)
+     * @param validSeconds lifetime of the token
+     */
+    std::string issue(Json::Value claims, uint32_t validSeconds) const;
+
+private:
+    std::string m_secret;
+};
@@ -0,0 +1,406 @@
+/**
+ * @file main.cpp
+ * @brief Load generator for m3t_restserver_messageboard
+ *
+ * Drives a running message board server over TLS with a configurable mix of requests and
+ * reports the throughput and the latency distribution of every endpoint.
+ *
+ * Features:
+ * - One persistent TLS connection per worker
+ * - Closed loop (every worker waits for its response) or open loop (requests are scheduled at
+ *   the target rate, latency is measured from the scheduled time)
+ * - Local HS256 access tokens (no login server or APISync needed)
+ *
+ */
+
+#include "config.h"
+#include "jwt.h"
+#include "workload.h"
+#include "metrics/histogram.h"
+#include "metrics/httpstatus.h"
+
+#include <json/reader.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <getopt.h>
+#include <sstream>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 6443;
+    std::string hostHeader;
+    std::string origin = "https://m3t-messageboard:6443";
+    std::string caFile;
+
+    size_t connections = 16;
+    uint32_t durationSeconds = 30;
+    uint32_t warmupSeconds = 5;
+    bool openLoop = false;
+    double rps = 0;
+    std::string mix = "threads=60,messages=30,post=8,edit=2";
+    size_t minThreads = 10;
+
+    std::string jwtSecret;
+    std::string user = "loadgen";
+    std::string scopes = "READER,WRITER";
+    std::string extraClaims;
+    std::string cookieName = "AccessToken";
+};
+
+struct OperationStats
+{
+    LatencyHistogram latency;
+    std::atomic<uint64_t> failed{0};
+    std::array<std::atomic<uint64_t>, METRICS_MAX_HTTP_STATUS> responses{};
+};
+
+static void usage()
+{
+    printf("%s v%s - %s\n\n", PROJECT_NAME, PROJECT_VER, PROJECT_DESCRIPTION);
+    printf("Usage: %s --jwt-secret-file <file> [options]\n\n", PROJECT_NAME);
+    printf("Target:\n");
+    printf("  -H, --host <addr>          Server address (default: 127.0.0.1)\n");
+    printf("  -p, --port <port>          Server port (default: 6443)\n");
+    printf("      --host-header <name>   Host header and TLS SNI (default: the address)\n");
+    printf("      --origin <url>         Origin header, must be in the server API Origins (default: https://m3t-messageboard:6443)\n");
+    printf("      --ca-file <file>       Verify the server certificate with this CA (default: not verified)\n\n");
+    printf("Load:\n");
+    printf("  -c, --connections <n>      Concurrent connections/workers (default: 16)\n");
+    printf("  -d, --duration <s>         Measured time (default: 30)\n");
+    printf("  -w, --warmup <s>           Time before measuring (default: 5)\n");
+    printf("  -m, --mode <closed|open>   Closed loop: next request when the response arrives (default).\n");
+    printf("                             Open loop: requests scheduled at --rps, latency includes the time behind schedule\n");
+    printf("  -r, --rps <n>              Target requests per second (closed loop: 0 = as fast as possible)\n");
+    printf("  -x, --mix <list>           Relative weights (default: threads=60,messages=30,post=8,edit=2)\n");
+    printf("      --min-threads <n>      Create threads until there are at least this many (default: 10)\n\n");
+    printf("Access token (HS256, the server must validate it with the same secret, configured in its JWT settings instead of APISync):\n");
+    printf("  -s, --jwt-secret-file <f>  Shared secret\n");
+    printf("  -u, --user <name>          Token subject (default: loadgen)\n");
+    printf("      --scopes <list>        Token scopes (default: READER,WRITER)\n");
+    printf("      --claims <json>        Extra claims merged into the token\n");
+    printf("      --cookie <name>        Access token cookie (default: AccessToken)\n");
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options)
+{
+    enum
+    {
+        OPT_HOST_HEADER = 256,
+        OPT_ORIGIN,
+        OPT_CA_FILE,
+        OPT_MIN_THREADS,
+        OPT_SCOPES,
+        OPT_CLAIMS,
+        OPT_COOKIE
+    };
+
+    static const option longOptions[] = {{"host", required_argument, nullptr, 'H'},
+                                         {"port", required_argument, nullptr, 'p'},
+                                         {"host-header", required_argument, nullptr, OPT_HOST_HEADER},
+                                         {"origin", required_argument, nullptr, OPT_ORIGIN},
+                                         {"ca-file", required_argument, nullptr, OPT_CA_FILE},
+                                         {"connections", required_argument, nullptr, 'c'},
+                                         {"duration", required_argument, nullptr, 'd'},
+                                         {"warmup", required_argument, nullptr, 'w'},
+                                         {"mode", required_argument, nullptr, 'm'},
+                                         {"rps", required_argument, nullptr, 'r'},
+                                         {"mix", required_argument, nullptr, 'x'},
+                                         {"min-threads", required_argument, nullptr, OPT_MIN_THREADS},
+                                         {"jwt-secret-file", required_argument, nullptr, 's'},
+                                         {"user", required_argument, nullptr, 'u'},
+                                         {"scopes", required_argument, nullptr, OPT_SCOPES},
+                                         {"claims", required_argument, nullptr, OPT_CLAIMS},
+                                         {"cookie", required_argument, nullptr, OPT_COOKIE},
+                                         {"help", no_argument, nullptr, 'h'},
+                                         {nullptr, 0, nullptr, 0}};
+
+    std::string secretFile;
+    int c;
+    while ((c = getopt_long(argc, argv, "H:p:c:d:w:m:r:x:s:u:h", longOptions, nullptr)) != -1)
+    {
+        switch (c)
+        {
+        case 'H':
+            options.host = optarg;
+            break;
+        case 'p':
+            options.port = static_cast<uint16_t>(atoi(optarg));
+            break;
+        case OPT_HOST_HEADER:
+            options.hostHeader = optarg;
+            break;
+        case OPT_ORIGIN:
+            options.origin = optarg;
+            break;
+        case OPT_CA_FILE:
+            options.caFile = optarg;
+            break;
+        case 'c':
+            options.connections = strtoul(optarg, nullptr, 10);
+            break;
+        case 'd':
+            options.durationSeconds = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+            break;
+        case 'w':
+            options.warmupSeconds = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+            break;
+        case 'm':
+            options.openLoop = std::string(optarg) == "open";
+            if (!options.openLoop && std::string(optarg) != "closed")
+            {
+                fprintf(stderr, "Invalid mode '%s' (closed or open)\n", optarg);
+                return false;
+            }
+            break;
+        case 'r':
+            options.rps = atof(optarg);
+            break;
+        case 'x':
+            options.mix = optarg;
+            break;
+        case OPT_MIN_THREADS:
+            options.minThreads = strtoul(optarg, nullptr, 10);
+            break;
+        case 's':
+            secretFile = optarg;
+            break;
+        case 'u':
+            options.user = optarg;
+            break;
+        case OPT_SCOPES:
+            options.scopes = optarg;
+            break;
+        case OPT_CLAIMS:
+            options.extraClaims = optarg;
+            break;
+        case OPT_COOKIE:
+            options.cookieName = optarg;
+            break;
+        default:
+            usage();
+            return false;
+        }
+    }
+
+    if (secretFile.empty())
+    {
+        usage();
+        return false;
+    }
+
+    std::ifstream in(secretFile);
+    if (!std::getline(in, options.jwtSecret) || options.jwtSecret.empty())
+    {
+        fprintf(stderr, "Failed to read the JWT secret from '%s'\n", secretFile.c_str());
+        return false;
+    }
+
+    if (options.connections == 0 || options.durationSeconds == 0)
+    {
+        fprintf(stderr, "Connections and duration must be greater than 0\n");
+        return false;
+    }
+    if (options.openLoop && options.rps <= 0)
+    {
+        fprintf(stderr, "The open loop mode requires --rps\n");
+        return false;
+    }
+    if (options.hostHeader.empty())
+        options.hostHeader = options.host;
+    return true;
+}
+
+static bool makeToken(const Options &options, std::string &token)
+{
+    Json::Value claims;
+    if (!options.extraClaims.empty())
+    {
+        Json::CharReaderBuilder reader;
+        std::istringstream in(options.extraClaims);
+        if (!Json::parseFromStream(reader, in, &claims, nullptr) || !claims.isObject())
+        {
+            fprintf(stderr, "Invalid --claims (a JSON object is expected)\n");
+            return false;
+        }
+    }
+
+    claims["sub"] = options.user;
+    Json::Value &scopes = claims["scopes"] = Json::arrayValue;
+    std::istringstream in(options.scopes);
+    std::string scope;
+    while (std::getline(in, scope, ','))
+        scopes.append(scope);
+
+    // Valid for the whole run
+    token = JWTIssuer(options.jwtSecret).issue(claims, options.warmupSeconds + options.durationSeconds + 3600);
+    return true;
+}
+
+static void worker(size_t index, const Options &options, SSL_CTX *ctx, Workload &workload, std::array<OperationStats, OP_COUNT> &stats, Clock::time_point measureFrom, Clock::time_point end)
+{
+    HTTPSClient client(ctx, options.host, options.port, options.hostHeader);
+    std::mt19937_64 rng(index * 7919 + 1);
+
+    // Every worker sends its share of the target rate, starting at a different offset.
+    Clock::duration interval = Clock::duration::zero();
+    if (options.rps > 0)
+        interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.connections / options.rps));
+    Clock::time_point next = Clock::now() + interval * index / options.connections;
+
+    HTTPSClient::Response response;
+    for (;;)
+    {
+        if (interval != Clock::duration::zero())
+        {
+            if (next >= end)
+                break;
+            std::this_thread::sleep_until(next);
+        }
+
+        Clock::time_point start = Clock::now();
+        if (start >= end)
+            break;
+
+        // Open loop: the time spent behind schedule (waiting for this connection) is part of the latency.
+        Clock::time_point scheduled = options.openLoop ? next : start;
+
+        Operation op = workload.pick(rng);
+        bool ok = workload.execute(client, op, rng, response);
+        Clock::time_point done = Clock::now();
+
+        // Requests sent before the deadline are counted, even when their response arrives after it.
+        if (scheduled >= measureFrom)
+        {
+            OperationStats &s = stats[op];
+            if (!ok)
+                s.failed.fetch_add(1, std::memory_order_relaxed);
+            else
+            {
+                s.latency.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(done - scheduled).count()));
+                if (response.status >= 0 && response.status < METRICS_MAX_HTTP_STATUS)
+                    s.responses[static_cast<size_t>(response.status)].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "Worker %zu: %s\n", index, client.error().c_str());
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        if (interval != Clock::duration::zero())
+        {
+            next += interval;
+            // Closed loop: don't try to catch up with a burst after a slow response.
+            if (!options.openLoop && next < done)
+                next = done;
+        }
+    }
+}
+
+static void report(const Options &options, const std::array<OperationStats, OP_COUNT> &stats)
+{
+    auto ms = [](uint64_t micros) { return static_cast<double>(micros) / 1000.0; };
+
+    printf("\n%s loop, %zu connection(s), %us measured", options.openLoop ? "Open" : "Closed", options.connections, options.durationSeconds);
+    if (options.rps > 0)
+        printf(", target %.1f req/s", options.rps);
+    printf("\n\n");
+    printf("%-15s %10s %8s %8s %10s %10s %10s %10s %10s\n", "endpoint", "requests", "non-2xx", "failed", "req/s", "p50(ms)", "p99(ms)", "p999(ms)", "max(ms)");
+
+    uint64_t totalRequests = 0;
+    for (size_t op = 0; op < OP_COUNT; op++)
+    {
+        const OperationStats &s = stats[op];
+        LatencyHistogram::Snapshot snapshot = s.latency.snapshot();
+        if (snapshot.count == 0 && s.failed == 0)
+            continue;
+
+        uint64_t non2xx = 0;
+        std::string statuses;
+        for (size_t status = 0; status < METRICS_MAX_HTTP_STATUS; status++)
+        {
+            uint64_t n = s.responses[status].load();
+            if (n && (status < 200 || status >= 300))
+            {
+                non2xx += n;
+                statuses += " " + std::to_string(status) + "x" + std::to_string(n);
+            }
+        }
+        totalRequests += snapshot.count;
+
+        printf("%-15s %10lu %8lu %8lu %10.1f %10.3f %10.3f %10.3f %10.3f\n", Workload::name(static_cast<Operation>(op)), static_cast<unsigned long>(snapshot.count), static_cast<unsigned long>(non2xx),
+               static_cast<unsigned long>(s.failed.load()), static_cast<double>(snapshot.count) / options.durationSeconds, ms(snapshot.quantile(0.5)), ms(snapshot.quantile(0.99)), ms(snapshot.quantile(0.999)),
+               ms(snapshot.quantile(1.0)));
+        if (!statuses.empty())
+            printf("%-15s status:%s\n", "", statuses.c_str());
+    }
+
+    printf("\nTotal: %lu requests, %.1f req/s (latencies are bucket upper bounds, within 25%%)\n", static_cast<unsigned long>(totalRequests), static_cast<double>(totalRequests) / options.durationSeconds);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return EXIT_FAILURE;
+
+    Workload workload;
+    std::string error;
+    if (!workload.setMix(options.mix, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::string token;
+    if (!makeToken(options, token))
+        return EXIT_FAILURE;
+    workload.setHeaders({"Cookie: " + options.cookieName + "=" + token, "Origin: " + options.origin, "Connection: keep-alive"});
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (!options.caFile.empty())
+    {
+        if (SSL_CTX_load_verify_locations(ctx, options.caFile.c_str(), nullptr) != 1)
+        {
+            fprintf(stderr, "Failed to load the CA file '%s'\n", options.caFile.c_str());
+            return EXIT_FAILURE;
+        }
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    }
+
+    {
+        HTTPSClient client(ctx, options.host, options.port, options.hostHeader);
+        if (!workload.prepare(client, options.minThreads, error))
+        {
+            fprintf(stderr, "Failed to prepare the board: %s\n", error.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("Running for %us (+%us warm-up) against %s:%u...\n", options.durationSeconds, options.warmupSeconds, options.host.c_str(), options.port);
+
+    std::array<OperationStats, OP_COUNT> stats;
+    Clock::time_point measureFrom = Clock::now() + std::chrono::seconds(options.warmupSeconds);
+    Clock::time_point end = measureFrom + std::chrono::seconds(options.durationSeconds);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < options.connections; i++)
+        workers.emplace_back(worker, i, std::cref(options), ctx, std::ref(workload), std::ref(stats), measureFrom, end);
+    for (auto &t : workers)
+        t.join();
+
+    report(options, stats);
+
+    SSL_CTX_free(ctx);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+#include "workload.h"
+
+#include <json/reader.h>
+#include <json/value.h>
+#include <json/writer.h>
+
+#include <sstream>
+
+// Own message ids kept for edits
+#define OWN_MESSAGES_MAX 10000
+
+static std::string toJSON(const Json::Value &value)
+{
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, value);
+}
+
+static bool fromJSON(const std::string &text, Json::Value &value)
+{
+    Json::CharReaderBuilder reader;
+    std::istringstream in(text);
+    return Json::parseFromStream(reader, in, &value, nullptr);
+}
+
+// Percent-encoding of the query string, as the browser does it.
+static std::string urlEncode(const std::string &text)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : text)
+    {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || c == '{' || c == '}' || c == ':' || c == ',')
+            out += static_cast<char>(c);
+        else
+        {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+    return out;
+}
+
+static std::string randomContent(std::mt19937_64 &rng)
+{
+    static const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "board", "thread", "reply", "load", "test", "latency", "message"};
+    std::uniform_int_distribution<size_t> word(0, sizeof(words) / sizeof(words[0]) - 1);
+    std::uniform_int_distribution<size_t> length(5, 40);
+
+    std::string content;
+    for (size_t n = length(rng); n; n--)
+    {
+        if (!content.empty())
+            content += ' ';
+        content += words[word(rng)];
+    }
+    return content;
+}
+
+const char *Workload::name(Operation op)
+{
+    switch (op)
+    {
+    case OP_GET_THREADS:
+        return "GET threads";
+    case OP_GET_MESSAGES:
+        return "GET messages";
+    case OP_POST_MESSAGE:
+        return "POST messages";
+    case OP_EDIT_MESSAGE:
+        return "PUT messages";
+    default:
+        return "?";
+    }
+}
+
+bool Workload::setMix(const std::string &mix, std::string &error)
+{
+    static const char *keys[OP_COUNT] = {"threads", "messages", "post", "edit"};
+
+    std::array<uint32_t, OP_COUNT> weights{};
+    std::istringstream in(mix);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos)
+        {
+            error = "Invalid mix entry '" + item + "' (expected name=weight)";
+            return false;
+        }
+
+        std::string key = item.substr(0, eq);
+        size_t op = 0;
+        while (op < OP_COUNT && key != keys[op])
+            op++;
+        if (op == OP_COUNT)
+        {
+            error = "Unknown operation '" + key + "' in mix (threads, messages, post, edit)";
+            return false;
+        }
+        weights[op] = static_cast<uint32_t>(strtoul(item.c_str() + eq + 1, nullptr, 10));
+    }
+
+    uint64_t total = 0;
+    for (uint32_t weight : weights)
+        total += weight;
+    if (total == 0)
+    {
+        error = "The mix has no operations";
+        return false;
+    }
+
+    m_weights = weights;
+    return true;
+}
+
+Operation Workload::pick(std::mt19937_64 &rng) const
+{
+    uint32_t total = 0;
+    for (uint32_t weight : m_weights)
+        total += weight;
+
+    uint32_t r = std::uniform_int_distribution<uint32_t>(0, total - 1)(rng);
+    for (size_t op = 0; op < OP_COUNT; op++)
+    {
+        if (r < m_weights[op])
+            return static_cast<Operation>(op);
+        r -= m_weights[op];
+    }
+    return OP_GET_THREADS;
+}
+
+bool Workload::get(HTTPSClient &client, const std::string &path, const std::string &json, HTTPSClient::Response &response)
+{
+    return client.request("GET", "/api/v1/" + path + "?" + urlEncode(json), "", m_headers, response);
+}
+
+bool Workload::send(HTTPSClient &client, const std::string &method, const std::string &path, const std::string &json, HTTPSClient::Response &response)
+{
+    return client.request(method, "/api/v1/" + path, json, m_headers, response);
+}
+
+bool Workload::prepare(HTTPSClient &client, size_t minThreads, std::string &error)
+{
+    HTTPSClient::Response response;
+    for (;;)
+    {
+        if (!get(client, "threads", "{\"limit\":200}", response))
+        {
+            error = client.error();
+            return false;
+        }
+        if (response.status != 200)
+        {
+            error = "GET threads failed with HTTP " + std::to_string(response.status) + ": " + response.body;
+            return false;
+        }
+        updateThreads(response.body);
+
+        size_t threads;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            threads = m_threadIds.size();
+        }
+        if (threads >= minThreads)
+            return true;
+
+        Json::Value thread;
+        thread["title"] = "Load test thread " + std::to_string(threads + 1);
+        if (!send(client, "POST", "threads", toJSON(thread), response))
+        {
+            error = client.error();
+            return false;
+        }
+        if (response.status != 200)
+        {
+            error = "POST threads failed with HTTP " + std::to_string(response.status) + ": " + response.body;
+            return false;
+        }
+    }
+}
+
+bool Workload::execute(HTTPSClient &client, Operation op, std::mt19937_64 &rng, HTTPSClient::Response &response)
+{
+    Json::Value request;
+    switch (op)
+    {
+    case OP_GET_THREADS:
+        request["limit"] = 50;
+        if (!get(client, "threads", toJSON(request), response))
+            return false;
+        if (response.status == 200)
+            updateThreads(response.body);
+        return true;
+
+    case OP_GET_MESSAGES:
+        request["threadId"] = randomThread(rng);
+        request["limit"] = 50;
+        return get(client, "messages", toJSON(request), response);
+
+    case OP_EDIT_MESSAGE:
+    {
+        uint32_t messageId;
+        if (randomOwnMessage(rng, messageId))
+        {
+            request["messageId"] = messageId;
+            request["content"] = randomContent(rng);
+            return send(client, "PUT", "messages", toJSON(request), response);
+        }
+        // Nothing posted yet: post instead.
+        [[fallthrough]];
+    }
+
+    case OP_POST_MESSAGE:
+    default:
+    {
+        request["threadId"] = randomThread(rng);
+        request["content"] = randomContent(rng);
+        if (!send(client, "POST", "messages", toJSON(request), response))
+            return false;
+
+        Json::Value posted;
+        if (response.status == 200 && fromJSON(response.body, posted) && posted["messageId"].isUInt())
+            addOwnMessage(posted["messageId"].asUInt());
+        return true;
+    }
+    }
+}
+
+uint32_t Workload::randomThread(std::mt19937_64 &rng)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_threadIds.empty())
+        return 1;
+    return m_threadIds[std::uniform_int_distribution<size_t>(0, m_threadIds.size() - 1)(rng)];
+}
+
+bool Workload::randomOwnMessage(std::mt19937_64 &rng, uint32_t &messageId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_ownMessageIds.empty())
+        return false;
+    messageId = m_ownMessageIds[std::uniform_int_distribution<size_t>(0, m_ownMessageIds.size() - 1)(rng)];
+    return true;
+}
+
+void Workload::addOwnMessage(uint32_t messageId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_ownMessageIds.size() < OWN_MESSAGES_MAX)
+    {
+        m_ownMessageIds.push_back(messageId);
+        return;
+    }
+    m_ownMessageIds[m_ownMessagesNext] = messageId;
+    m_ownMessagesNext = (m_ownMessagesNext + 1) % OWN_MESSAGES_MAX;
+}
+
+void Workload::updateThreads(const std::string &body)
+{
+    Json::Value response;
+    if (!fromJSON(body, response) || !response["threads"].isArray() || response["threads"].empty())
+        return;
+
+    std::vector<uint32_t> threadIds;
+    for (const Json::Value &thread : response["threads"])
+    {
+        if (thread["threadId"].isUInt() && !thread["isLocked"].asBool())
+            threadIds.push_back(thread["threadId"].asUInt());
+    }
+
+    // The first page is the active part of the board, that's what the clients read and write.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!threadIds.empty())
+        m_threadIds = std::move(threadIds);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "httpsclient.h"
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+enum Operation
+{
+    OP_GET_THREADS = 0,
+    OP_GET_MESSAGES,
+    OP_POST_MESSAGE,
+    OP_EDIT_MESSAGE,
+    OP_COUNT
+};
+
+/**
+ * @brief Request mix sent to the message board API
+ *
+ * Requests are built like the web frontend does (GET parameters as JSON in the query string,
+ * JSON bodies otherwise). The ids seen in the responses (threads, own messages) are shared by
+ * all the workers to build the next requests.
+ */
+class Workload
+{
+public:
+    static const char *name(Operation op);
+
+    /**
+     * @brief Parse the mix ("threads=60,messages=30,post=8,edit=2", weights are relative)
+     * @return false on syntax error (error describes it)
+     */
+    bool setMix(const std::string &mix, std::string &error);
+
+    /**
+     * @param headers header lines sent with every request (access token cookie, origin)
+     */
+    void setHeaders(const std::vector<std::string> &headers) { m_headers = headers; }
+
+    /**
+     * @brief Load the thread list, creating threads until there are at least minThreads
+     * @return false if the server can't be used (error describes it)
+     */
+    bool prepare(HTTPSClient &client, size_t minThreads, std::string &error);
+
+    Operation pick(std::mt19937_64 &rng) const;
+
+    /**
+     * @brief Run one request of the given kind
+     * @return false on connection error (the response is not valid)
+     */
+    bool execute(HTTPSClient &client, Operation op, std::mt19937_64 &rng, HTTPSClient::Response &response);
+
+private:
+    bool get(HTTPSClient &client, const std::string &path, const std::string &json, HTTPSClient::Response &response);
+    bool send(HTTPSClient &client, const std::string &method, const std::string &path, const std::string &json, HTTPSClient::Response &response);
+
+    uint32_t randomThread(std::mt19937_64 &rng);
+    bool randomOwnMessage(std::mt19937_64 &rng, uint32_t &messageId);
+    void addOwnMessage(uint32_t messageId);
+    void updateThreads(const std::string &body);
+
+    std::array<uint32_t, OP_COUNT> m_weights{60, 30, 8, 2};
+    std::vector<std::string> m_headers;
+
+    std::mutex m_mutex;
+    std::vector<uint32_t> m_threadIds;
+    // Messages posted by this run (the only ones the token user may edit)
+    std::vector<uint32_t> m_ownMessageIds;
+    size_t m_ownMessagesNext = 0;
+};
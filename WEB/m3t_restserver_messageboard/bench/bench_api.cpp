@@ -0,0 +1,312 @@
+/**
+ * @file bench_api.cpp
+ * @brief Micro-benchmarks of the message board endpoint handlers
+ *
+ * The handlers of endpoints/api.cpp are called directly (no TLS/HTTP stack) against a seeded
+ * database in a temporary directory, with the same connection pool and write queue as the
+ * server. Reports ns/op and allocs/op (operator new calls from every thread, SQLite's own
+ * allocations are not included).
+ *
+ * Usage: m3t_restserver_messageboard_bench [--threads=N] [--messages=N] [benchmark options]
+ */
+
+#include "dbinit.h"
+#include "definitions/context.h"
+#include "endpoints/api.h"
+
+#include <Mantids30/Memory/a_allvars.h>
+#include <benchmark/benchmark.h>
+#include <boost/property_tree/ptree.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <unistd.h>
+
+using namespace Mantids30;
+using namespace Mantids30::Memory;
+
+AppContext g_ctx;
+
+// ============================================================================
+// ALLOCATION COUNTER
+// ============================================================================
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// ============================================================================
+// FIXTURES
+// ============================================================================
+
+static uint32_t g_threads = 200;
+static uint32_t g_messagesPerThread = 200;
+
+struct Request
+{
+    Json::Value input;
+    DataFormat::JWT::Token token;
+    API::RESTful::RequestParameters params;
+    Sessions::ClientDetails client;
+
+    Request()
+    {
+        token.setSubject("bench");
+        params.inputJSON = &input;
+        params.jwtToken = &token;
+        client.ipAddress = "127.0.0.1";
+        client.userAgent = "m3t_restserver_messageboard_bench";
+    }
+};
+
+using Handler = API::APIReturn (*)(void *, const API::RESTful::RequestParameters &, Sessions::ClientDetails &);
+
+// Runs the handler once per iteration, prepare() sets the input of every call.
+template <typename Prepare>
+static void runHandler(benchmark::State &state, Handler handler, Prepare prepare)
+{
+    Request request;
+    uint64_t iteration = 0;
+
+    prepare(request.input, iteration);
+    API::APIReturn check = handler(nullptr, request.params, request.client);
+    if (check.getHTTPResponseCode() != Network::Protocols::HTTP::Status::S_200_OK)
+    {
+        state.SkipWithError("The handler did not return 200");
+        return;
+    }
+
+    uint64_t allocations = g_allocations.load(std::memory_order_relaxed);
+    for (auto _ : state)
+    {
+        prepare(request.input, ++iteration);
+        API::APIReturn result = handler(nullptr, request.params, request.client);
+        benchmark::DoNotOptimize(result);
+    }
+    allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+
+    state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(allocations), benchmark::Counter::kAvgIterations);
+}
+
+static uint32_t threadOf(uint64_t iteration)
+{
+    // Spread the calls over the threads (multiplicative hash, so pages aren't read in order)
+    return static_cast<uint32_t>((iteration * 2654435761u) % g_threads) + 1;
+}
+
+// ============================================================================
+// BENCHMARKS
+// ============================================================================
+
+// First page of the thread list, built from the thread index
+static void BM_getThreads(benchmark::State &state)
+{
+    runHandler(state, &getThreads, [](Json::Value &input, uint64_t) { input["limit"] = 50; });
+}
+BENCHMARK(BM_getThreads);
+
+static void BM_getMessages(benchmark::State &state)
+{
+    runHandler(state, &getMessages,
+               [](Json::Value &input, uint64_t iteration)
+               {
+                   input["threadId"] = threadOf(iteration);
+                   input["limit"] = 50;
+               });
+}
+BENCHMARK(BM_getMessages);
+
+static void BM_getMessagesBatch(benchmark::State &state)
+{
+    runHandler(state, &getMessagesBatch,
+               [](Json::Value &input, uint64_t iteration)
+               {
+                   input["threadIds"] = Json::arrayValue;
+                   for (uint64_t i = 0; i < 10; i++)
+                       input["threadIds"].append(threadOf(iteration * 10 + i));
+                   input["limit"] = 10;
+               });
+}
+BENCHMARK(BM_getMessagesBatch);
+
+static void BM_searchMessages(benchmark::State &state)
+{
+    runHandler(state, &searchMessages,
+               [](Json::Value &input, uint64_t iteration)
+               {
+                   input["q"] = "thread " + std::to_string(threadOf(iteration));
+                   input["limit"] = 50;
+               });
+}
+BENCHMARK(BM_searchMessages);
+
+// New subscription (no lastEventId: from now)
+static void BM_getMessageEventsSubscribe(benchmark::State &state)
+{
+    runHandler(state, &getMessageEvents, [](Json::Value &input, uint64_t iteration) { input["threadId"] = threadOf(iteration); });
+}
+BENCHMARK(BM_getMessageEventsSubscribe);
+
+// Delta poll of a subscriber with state.range(0) pending events in its thread
+static void BM_getMessageEvents(benchmark::State &state)
+{
+    uint64_t lastEventId = g_ctx.messageEvents.lastEventId();
+
+    Json::Value message;
+    message["messageId"] = 1;
+    message["userId"] = "bench";
+    message["content"] = "Message event: lorem ipsum dolor sit amet, consectetur adipiscing elit";
+    message["createdAt"] = "2024-01-01 00:00:00";
+    for (int64_t i = 0; i < state.range(0); i++)
+    {
+        for (uint32_t threadId = 1; threadId <= g_threads; threadId++)
+            g_ctx.messageEvents.publish(threadId, "created", message);
+    }
+
+    runHandler(state, &getMessageEvents,
+               [lastEventId](Json::Value &input, uint64_t iteration)
+               {
+                   input["threadId"] = threadOf(iteration);
+                   input["lastEventId"] = static_cast<Json::UInt64>(lastEventId);
+               });
+}
+// Up to the events kept per thread (see AppContext::messageEvents)
+BENCHMARK(BM_getMessageEvents)->Arg(1)->Arg(16)->Arg(128);
+
+// Writes include the commit (one transaction per call, nothing to group with)
+static void BM_postMessage(benchmark::State &state)
+{
+    runHandler(state, &postMessage,
+               [](Json::Value &input, uint64_t iteration)
+               {
+                   input["threadId"] = threadOf(iteration);
+                   input["content"] = "Benchmark reply " + std::to_string(iteration) + " lorem ipsum dolor sit amet";
+               });
+}
+BENCHMARK(BM_postMessage);
+
+static void BM_editMessage(benchmark::State &state)
+{
+    runHandler(state, &editMessage,
+               [](Json::Value &input, uint64_t iteration)
+               {
+                   // Seeded messages: (thread - 1) * messagesPerThread + n
+                   input["messageId"] = (threadOf(iteration) - 1) * g_messagesPerThread + 1;
+                   input["content"] = "Benchmark edit " + std::to_string(iteration);
+               });
+}
+BENCHMARK(BM_editMessage);
+
+// ============================================================================
+// DATABASE SETUP
+// ============================================================================
+
+static bool seedDatabase()
+{
+    API::APIReturn result = g_ctx.dbWriteQueue.submit(
+        [](SQLConnector_SQLite3 *db, API::APIReturn &) -> bool
+        {
+            if (!db->execute("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < :threads) "
+                             "INSERT INTO `mboard`.`threads` (`threadId`, `title`, `creatorUserId`) SELECT i, 'Benchmark thread ' || i, 'bench' FROM n;",
+                             {{":threads", MAKE_VAR(UINT32, g_threads)}}))
+                return false;
+
+            if (!db->execute("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < :count) "
+                             "INSERT INTO `mboard`.`messages` (`messageId`, `threadId`, `userId`, `content`, `ipAddress`, `userAgent`) "
+                             "SELECT (t.`threadId` - 1) * :count + n.i, t.`threadId`, 'bench', "
+                             "'Message ' || n.i || ' of thread ' || t.`threadId` || ': lorem ipsum dolor sit amet, consectetur adipiscing elit', '127.0.0.1', 'bench' "
+                             "FROM `mboard`.`threads` t, n;",
+                             {{":count", MAKE_VAR(UINT32, g_messagesPerThread)}}))
+                return false;
+
+            return db->execute("UPDATE `mboard`.`threads` SET `messageCount`=:count, `lastPosterId`='bench', `lastMessageId`=`threadId` * :count;",
+                               {{":count", MAKE_VAR(UINT32, g_messagesPerThread)}});
+        },
+        [] { g_ctx.threadIndex.load(g_ctx.dbPool.writer()); });
+
+    return result.getHTTPResponseCode() == Network::Protocols::HTTP::Status::S_200_OK;
+}
+
+// ============================================================================
+// ENTRY POINT
+// ============================================================================
+
+int main(int argc, char *argv[])
+{
+    benchmark::Initialize(&argc, argv);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strncmp(argv[i], "--threads=", 10))
+            g_threads = std::max(1ul, strtoul(argv[i] + 10, nullptr, 10));
+        else if (!strncmp(argv[i], "--messages=", 11))
+            g_messagesPerThread = std::max(1ul, strtoul(argv[i] + 11, nullptr, 10));
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    char dbDirectory[] = "/tmp/m3t_messageboard_bench_XXXXXX";
+    if (!mkdtemp(dbDirectory))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    g_ctx.config.put("Logs.Debug", false);
+    g_ctx.config.put("DB.Directory", dbDirectory);
+    g_ctx.config.put("DB.Maintenance.Enabled", false);
+    g_ctx.startTime = time(nullptr);
+
+    // The application log goes to stdout: keep it out of the benchmark report.
+    int reportFD = dup(STDOUT_FILENO);
+    if (!freopen("/dev/null", "w", stdout))
+        return EXIT_FAILURE;
+    std::ofstream reportStream("/dev/fd/" + std::to_string(reportFD));
+
+    APP_LOG = Config::Logs::createAppLog(g_ctx.config);
+    RPC_LOG = Config::Logs::createRPCLog(g_ctx.config);
+
+    int rc = EXIT_FAILURE;
+    if (!initDatabase() || !seedDatabase())
+        fprintf(stderr, "Failed to set up the benchmark database in %s\n", dbDirectory);
+    else
+    {
+        reportStream << "Database: " << g_threads << " threads x " << g_messagesPerThread << " messages, " << g_ctx.dbPool.readersCount() << " reader(s)" << std::endl;
+
+        benchmark::ConsoleReporter reporter;
+        reporter.SetOutputStream(&reportStream);
+        reporter.SetErrorStream(&std::cerr);
+        benchmark::RunSpecifiedBenchmarks(&reporter);
+        rc = EXIT_SUCCESS;
+    }
+
+    benchmark::Shutdown();
+    g_ctx.dbWriteQueue.stop();
+    std::filesystem::remove_all(dbDirectory);
+    return rc;
+}
@@ -0,0 +1,279 @@
+#include "threadindex.h"
+
+#include "../definitions/context.h"
+
+#include <Mantids30/Memory/a_allvars.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <tuple>
+
+using namespace Mantids30::Memory;
+
+#define THREAD_INDEX_COLUMNS "`threadId`, `title`, `creatorUserId`, `createdAt`, `lastPostAt`, `isPinned`, `isLocked`, `messageCount`, `lastMessageId`, `lastPosterId`"
+
+// Listing order, a thread comes first when its key is greater (same as the ORDER BY ... DESC of the table)
+static auto listingKey(const ThreadIndex::Thread &thread)
+{
+    return std::tie(thread.isPinned, thread.lastPostAt, thread.threadId);
+}
+
+static bool listedBefore(const std::shared_ptr<const ThreadIndex::Thread> &a, const std::shared_ptr<const ThreadIndex::Thread> &b)
+{
+    return listingKey(*a) > listingKey(*b);
+}
+
+// Result columns of a thread row (THREAD_INDEX_COLUMNS)
+struct ThreadRow
+{
+    Abstract::UINT32 threadId, messageCount, lastMessageId;
+    Abstract::STRING title, creatorUserId, createdAt, lastPostAt, lastPosterId;
+    Abstract::BOOL isPinned, isLocked;
+
+    std::vector<Abstract::Var *> columns() { return {&threadId, &title, &creatorUserId, &createdAt, &lastPostAt, &isPinned, &isLocked, &messageCount, &lastMessageId, &lastPosterId}; }
+
+    // Reads every row of the query
+    void readAll(SQLConnector::QueryInstance &i, std::vector<std::shared_ptr<const ThreadIndex::Thread>> &threads)
+    {
+        while (i.getResultsOK() && i.query->step())
+        {
+            auto thread = std::make_shared<ThreadIndex::Thread>();
+            thread->threadId = threadId.getValue();
+            thread->title = title.getValue();
+            thread->creatorUserId = creatorUserId.getValue();
+            thread->createdAt = createdAt.getValue();
+            thread->lastPostAt = lastPostAt.getValue();
+            thread->isPinned = isPinned.getValue();
+            thread->isLocked = isLocked.getValue();
+            thread->messageCount = messageCount.getValue();
+            thread->lastMessageId = lastMessageId.getValue();
+            thread->lastPosterId = lastPosterId.getValue();
+            threads.push_back(std::move(thread));
+        }
+    }
+};
+
+// First chunk whose last row is not listed before the thread: the chunk where the thread is (or
+// would be) listed, chunks.size() if it is listed after all of them.
+static size_t chunkOf(const std::vector<std::shared_ptr<const ThreadIndex::Snapshot::Chunk>> &chunks, const ThreadIndex::Thread &thread)
+{
+    return std::partition_point(chunks.begin(), chunks.end(), [&thread](const std::shared_ptr<const ThreadIndex::Snapshot::Chunk> &chunk) { return listingKey(*chunk->back()) > listingKey(thread); })
+           - chunks.begin();
+}
+
+static void setOffsets(ThreadIndex::Snapshot &snapshot)
+{
+    snapshot.offsets.resize(snapshot.chunks.size());
+    snapshot.size = 0;
+    for (size_t i = 0; i < snapshot.chunks.size(); i++)
+    {
+        snapshot.offsets[i] = snapshot.size;
+        snapshot.size += snapshot.chunks[i]->size();
+    }
+}
+
+const ThreadIndex::Thread &ThreadIndex::Snapshot::at(size_t position) const
+{
+    size_t chunk = static_cast<size_t>(std::upper_bound(offsets.begin(), offsets.end(), position) - offsets.begin()) - 1;
+    return *(*chunks[chunk])[position - offsets[chunk]];
+}
+
+size_t ThreadIndex::Snapshot::after(bool isPinned, const std::string &lastPostAt, uint32_t threadId) const
+{
+    auto cursor = std::tie(isPinned, lastPostAt, threadId);
+    auto listedUpTo = [&cursor](const std::shared_ptr<const Thread> &thread) { return !(listingKey(*thread) < cursor); };
+
+    // The chunk of the first thread listed after the cursor, then its position in the chunk.
+    size_t chunk = std::partition_point(chunks.begin(), chunks.end(), [&listedUpTo](const std::shared_ptr<const Chunk> &c) { return listedUpTo(c->back()); }) - chunks.begin();
+    if (chunk == chunks.size())
+        return size;
+    return offsets[chunk] + (std::partition_point(chunks[chunk]->begin(), chunks[chunk]->end(), listedUpTo) - chunks[chunk]->begin());
+}
+
+ThreadIndex::ThreadIndex()
+    : m_snapshot(std::make_shared<const Snapshot>())
+{}
+
+std::shared_ptr<const ThreadIndex::Snapshot> ThreadIndex::snapshot() const
+{
+    return std::atomic_load_explicit(&m_snapshot, std::memory_order_acquire);
+}
+
+bool ThreadIndex::load(SQLConnector_SQLite3 *db)
+{
+    ThreadRow row;
+
+    // Read through idx_threads_order, already in listing order.
+    SQLConnector::QueryInstance i = db->qSelect("SELECT " THREAD_INDEX_COLUMNS " FROM `mboard`.`threads` ORDER BY `isPinned` DESC, `lastPostAt` DESC, `threadId` DESC;", {}, row.columns());
+    if (!i.getResultsOK())
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Failed to load the thread list");
+        return false;
+    }
+
+    std::vector<std::shared_ptr<const Thread>> threads;
+    row.readAll(i, threads);
+
+    // update() and Snapshot::after() rely on the exact order of listingKey (SQLite already sorts text bytewise).
+    std::stable_sort(threads.begin(), threads.end(), &listedBefore);
+
+    auto next = std::make_shared<Snapshot>();
+    for (size_t first = 0; first < threads.size(); first += THREAD_INDEX_CHUNK_SIZE)
+        next->chunks.push_back(std::make_shared<const Snapshot::Chunk>(threads.begin() + first, threads.begin() + std::min(first + THREAD_INDEX_CHUNK_SIZE, threads.size())));
+    setOffsets(*next);
+
+    // Staged changes are older than the rows just read.
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    m_staged.clear();
+    m_rows.clear();
+    for (const auto &thread : threads)
+        m_rows[thread->threadId] = thread;
+    publish(std::move(next));
+    return true;
+}
+
+std::shared_ptr<const ThreadIndex::Thread> ThreadIndex::fetch(SQLConnector_SQLite3 *db, uint32_t threadId)
+{
+    ThreadRow row;
+    SQLConnector::QueryInstance i = db->qSelect("SELECT " THREAD_INDEX_COLUMNS " FROM `mboard`.`threads` WHERE `threadId`=:threadId;", {{":threadId", MAKE_VAR(UINT32, threadId)}}, row.columns());
+
+    std::vector<std::shared_ptr<const Thread>> threads;
+    row.readAll(i, threads);
+    return threads.empty() ? nullptr : threads.front();
+}
+
+void ThreadIndex::update(std::shared_ptr<const Thread> thread)
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    uint32_t threadId = thread->threadId;
+    m_staged[threadId] = std::move(thread);
+}
+
+void ThreadIndex::remove(const std::vector<uint32_t> &threadIds)
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    for (uint32_t threadId : threadIds)
+        m_staged[threadId] = nullptr;
+}
+
+bool ThreadIndex::publishStaged()
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    if (m_staged.empty())
+        return false;
+
+    std::shared_ptr<const Snapshot> current = snapshot();
+
+    // Chunk pointers of the next version, and the chunks it copied (nullptr: shared with the current one)
+    std::vector<std::shared_ptr<const Snapshot::Chunk>> chunks = current->chunks;
+    std::vector<Snapshot::Chunk *> copied(chunks.size(), nullptr);
+    auto writable = [&chunks, &copied](size_t i) -> Snapshot::Chunk &
+    {
+        if (!copied[i])
+        {
+            auto copy = std::make_shared<Snapshot::Chunk>(*chunks[i]);
+            copied[i] = copy.get();
+            chunks[i] = std::move(copy);
+        }
+        return *copied[i];
+    };
+
+    // 1) The previous version of every staged thread is taken out. Positions are found in the
+    //    current version, then erased from the last one (the others stay valid).
+    std::vector<std::pair<size_t, size_t>> previous;
+    std::vector<std::shared_ptr<const Thread>> changed;
+    changed.reserve(m_staged.size());
+    for (auto &staged : m_staged)
+    {
+        auto row = m_rows.find(staged.first);
+        if (row != m_rows.end())
+        {
+            size_t chunk = chunkOf(current->chunks, *row->second);
+            const Snapshot::Chunk &rows = *current->chunks[chunk];
+            previous.emplace_back(chunk, std::lower_bound(rows.begin(), rows.end(), row->second, &listedBefore) - rows.begin());
+        }
+
+        if (staged.second)
+        {
+            m_rows[staged.first] = staged.second;
+            changed.push_back(std::move(staged.second));
+        }
+        else if (row != m_rows.end())
+            m_rows.erase(row);
+    }
+    std::sort(previous.rbegin(), previous.rend());
+    for (const auto &[chunk, position] : previous)
+    {
+        Snapshot::Chunk &rows = writable(chunk);
+        rows.erase(rows.begin() + position);
+    }
+
+    // Emptied chunks are dropped (the chunks are searched by their last row).
+    size_t kept = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        if (chunks[i]->empty())
+            continue;
+        chunks[kept] = std::move(chunks[i]);
+        copied[kept++] = copied[i];
+    }
+    chunks.resize(kept);
+    copied.resize(kept);
+
+    // 2) The new version of every staged thread is put in its chunk.
+    for (auto &thread : changed)
+    {
+        if (chunks.empty())
+        {
+            auto chunk = std::make_shared<Snapshot::Chunk>(1, std::move(thread));
+            copied.push_back(chunk.get());
+            chunks.push_back(std::move(chunk));
+            continue;
+        }
+
+        // Listed after every chunk: at the end of the last one.
+        size_t chunk = std::min(chunkOf(chunks, *thread), chunks.size() - 1);
+        Snapshot::Chunk &rows = writable(chunk);
+        rows.insert(std::upper_bound(rows.begin(), rows.end(), thread, &listedBefore), std::move(thread));
+    }
+
+    // 3) Copied chunks are kept within bounds: small ones are merged with the next chunk, large ones split.
+    auto next = std::make_shared<Snapshot>();
+    next->chunks.reserve(chunks.size() + 1);
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        if (!copied[i])
+        {
+            next->chunks.push_back(std::move(chunks[i]));
+            continue;
+        }
+
+        Snapshot::Chunk &rows = *copied[i];
+        if (rows.size() < THREAD_INDEX_CHUNK_SIZE / 4 && i + 1 < chunks.size() && rows.size() + chunks[i + 1]->size() <= 2 * THREAD_INDEX_CHUNK_SIZE)
+        {
+            Snapshot::Chunk &merged = writable(i + 1);
+            merged.insert(merged.begin(), std::make_move_iterator(rows.begin()), std::make_move_iterator(rows.end()));
+            continue;
+        }
+
+        if (rows.size() <= 2 * THREAD_INDEX_CHUNK_SIZE)
+        {
+            next->chunks.push_back(std::move(chunks[i]));
+            continue;
+        }
+        for (size_t first = 0; first < rows.size(); first += THREAD_INDEX_CHUNK_SIZE)
+            next->chunks.push_back(std::make_shared<const Snapshot::Chunk>(rows.begin() + first, rows.begin() + std::min(first + THREAD_INDEX_CHUNK_SIZE, rows.size())));
+    }
+    setOffsets(*next);
+
+    m_staged.clear();
+    publish(std::move(next));
+    return true;
+}
+
+void ThreadIndex::publish(std::shared_ptr<Snapshot> snapshot)
+{
+    // The previous version is released by its last reader.
+    std::atomic_store_explicit(&m_snapshot, std::shared_ptr<const Snapshot>(std::move(snapshot)), std::memory_order_release);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <Mantids30/DB_SQLite3/sqlconnector_sqlite3.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Rows per chunk of a version of the thread list (chunks grow up to twice this size before being split)
+#define THREAD_INDEX_CHUNK_SIZE 256
+
+/**
+ * @brief In-memory copy of the thread list (the `threads` table), in listing order
+ *
+ * Readers get the current version with snapshot() and use it for as long as they need: a version
+ * is immutable, and it stays alive while somebody holds it (shared ownership, so there is nothing
+ * to reclaim by hand). Writers (the writer thread, once a change is committed) stage the changed
+ * rows, and once per committed batch the next version is built from the current one and published
+ * with an atomic pointer swap, so readers never wait for a write.
+ *
+ * A version keeps its rows in chunks: the next version only copies the chunks where a row is taken
+ * out or put in, the other chunks (and every unchanged row) are shared with the current version.
+ * A batch costs the array of chunk pointers plus the touched chunks, not a copy of the whole list.
+ */
+class ThreadIndex
+{
+public:
+    struct Thread
+    {
+        uint32_t threadId = 0;
+        std::string title;
+        std::string creatorUserId;
+        std::string createdAt;
+        std::string lastPostAt;
+        bool isPinned = false;
+        bool isLocked = false;
+        uint32_t messageCount = 0;
+        // Only meaningful when messageCount != 0
+        uint32_t lastMessageId = 0;
+        std::string lastPosterId;
+    };
+
+    struct Snapshot
+    {
+        using Chunk = std::vector<std::shared_ptr<const Thread>>;
+
+        // isPinned DESC, lastPostAt DESC, threadId DESC, split in chunks (none of them empty)
+        std::vector<std::shared_ptr<const Chunk>> chunks;
+        // Position of the first row of every chunk
+        std::vector<size_t> offsets;
+        size_t size = 0;
+
+        /**
+         * @brief Thread at the position (below size)
+         */
+        const Thread &at(size_t position) const;
+
+        /**
+         * @brief Position of the first thread listed after the given one (keyset pagination)
+         */
+        size_t after(bool isPinned, const std::string &lastPostAt, uint32_t threadId) const;
+    };
+
+    ThreadIndex();
+    ThreadIndex(const ThreadIndex &) = delete;
+    ThreadIndex &operator=(const ThreadIndex &) = delete;
+
+    /**
+     * @brief Current version of the thread list (never null)
+     */
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    /**
+     * @brief Replace the whole list with the content of the database (startup, bulk changes)
+     */
+    bool load(Mantids30::Database::SQLConnector_SQLite3 *db);
+
+    /**
+     * @brief Read one thread from the database (e.g. inside a write intent, after changing it)
+     * @return nullptr if the thread does not exist
+     */
+    static std::shared_ptr<const Thread> fetch(Mantids30::Database::SQLConnector_SQLite3 *db, uint32_t threadId);
+
+    /**
+     * @brief Stage the thread as added or replaced (call once the change is committed)
+     */
+    void update(std::shared_ptr<const Thread> thread);
+
+    /**
+     * @brief Stage the removal of the given threads (call once the change is committed)
+     */
+    void remove(const std::vector<uint32_t> &threadIds);
+
+    /**
+     * @brief Publish a version with the staged changes (once per committed batch)
+     * @return false if there was nothing staged
+     */
+    bool publishStaged();
+
+private:
+    void publish(std::shared_ptr<Snapshot> snapshot);
+
+    // Serializes the writers (stage, read, copy, swap), readers don't use it
+    std::mutex m_writeMutex;
+    // Changed rows not published yet, by threadId (nullptr: removed)
+    std::unordered_map<uint32_t, std::shared_ptr<const Thread>> m_staged;
+    // Rows of the current version by threadId (where the previous version of a changed row is listed)
+    std::unordered_map<uint32_t, std::shared_ptr<const Thread>> m_rows;
+    // Only accessed through std::atomic_load/std::atomic_store
+    std::shared_ptr<const Snapshot> m_snapshot;
+};
@@ -0,0 +1,42 @@
+#include "versiontracker.h"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <unistd.h>
+
+VersionTracker::VersionTracker()
+{
+    char epoch[64];
+    snprintf(epoch, sizeof(epoch), "%llx.%x", static_cast<unsigned long long>(std::chrono::system_clock::now().time_since_epoch().count()), static_cast<unsigned>(getpid()));
+    m_epoch = epoch;
+}
+
+std::string VersionTracker::pageTag(const std::string &page)
+{
+    // Only compared for equality (and the epoch changes with the process), a hash is enough.
+    char tag[32];
+    snprintf(tag, sizeof(tag), "%zx", std::hash<std::string>()(page));
+    return tag;
+}
+
+std::string VersionTracker::threadListETag(const std::string &page) const
+{
+    return "\"" + m_epoch + "-l" + std::to_string(m_threadListVersion.load(std::memory_order_acquire)) + "-" + pageTag(page) + "\"";
+}
+
+std::string VersionTracker::threadETag(uint32_t threadId, const std::string &page) const
+{
+    uint64_t version = m_threadVersions[threadId % VERSION_TRACKER_THREAD_SLOTS].load(std::memory_order_acquire);
+    return "\"" + m_epoch + "-t" + std::to_string(threadId) + "." + std::to_string(version) + "-" + pageTag(page) + "\"";
+}
+
+void VersionTracker::bumpThreadList()
+{
+    m_threadListVersion.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void VersionTracker::bumpThread(uint32_t threadId)
+{
+    m_threadVersions[threadId % VERSION_TRACKER_THREAD_SLOTS].fetch_add(1, std::memory_order_acq_rel);
+}
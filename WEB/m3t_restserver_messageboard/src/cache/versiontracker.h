@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Version counters shared by the threads (threadId % slots)
+#define VERSION_TRACKER_THREAD_SLOTS 4096
+
+/**
+ * @brief Version counters for the thread list and for the messages of every thread
+ *
+ * Mutating handlers bump the versions once their change is committed, GET handlers expose them
+ * as strong ETags. The ETags carry a per-process epoch, so a restart never reuses an old tag, and
+ * the page they were given for (page parameters of the request), so a tag only matches its page.
+ *
+ * Threads share a fixed set of counters (by threadId), so the memory does not grow with the threads
+ * ever changed: a change to a thread also changes the tags of the threads of its slot (a full answer
+ * instead of "not modified"), but a tag never stays the same across a change of its own thread.
+ */
+class VersionTracker
+{
+public:
+    VersionTracker();
+
+    /**
+     * @brief ETag of a page of the thread list (GET /api/v1/threads)
+     * @param page page parameters of the request (limit, cursor)
+     */
+    std::string threadListETag(const std::string &page) const;
+
+    /**
+     * @brief ETag of a page of the messages of a thread (GET /api/v1/messages)
+     * @param page page parameters of the request (limit, afterMessageId, beforeMessageId)
+     */
+    std::string threadETag(uint32_t threadId, const std::string &page) const;
+
+    void bumpThreadList();
+    void bumpThread(uint32_t threadId);
+
+private:
+    static std::string pageTag(const std::string &page);
+
+    std::string m_epoch;
+
+    std::atomic<uint64_t> m_threadListVersion{0};
+
+    std::array<std::atomic<uint64_t>, VERSION_TRACKER_THREAD_SLOTS> m_threadVersions{};
+};
@@ -0,0 +1,169 @@
+#include "connectionpool.h"
+
+#include "../definitions/context.h"
+#include "../metrics/metrics.h"
+
+#include <Mantids30/Memory/a_allvars.h>
+
+using namespace Mantids30;
+using namespace Mantids30::Memory;
+
+// PRAGMA's that return a value are executed as a query (and the value is returned).
+static bool queryPragma(SQLConnector_SQLite3 *connector, const std::string &pragma, std::string *value = nullptr)
+{
+    Abstract::STRING result;
+    SQLConnector::QueryInstance i = connector->qSelect(pragma, {}, {&result});
+    if (!i.getResultsOK())
+        return false;
+    if (i.query->step() && value)
+        *value = result.getValue();
+    return true;
+}
+
+ConnectionPool::Lease::Lease(ConnectionPool *pool, SQLConnector_SQLite3 *connector)
+    : m_pool(pool)
+    , m_connector(connector)
+    , m_acquiredAt(std::chrono::steady_clock::now())
+{}
+
+ConnectionPool::Lease::Lease(Lease &&other) noexcept
+    : m_pool(other.m_pool)
+    , m_connector(other.m_connector)
+    , m_acquiredAt(other.m_acquiredAt)
+{
+    other.m_connector = nullptr;
+}
+
+ConnectionPool::Lease::~Lease()
+{
+    if (m_connector)
+    {
+        Metrics::addSQL(std::chrono::steady_clock::now() - m_acquiredAt);
+        m_pool->release(m_connector);
+    }
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    for (auto *reader : m_readers)
+        delete reader;
+    delete m_writer;
+}
+
+bool ConnectionPool::openWriter(const std::map<std::string, std::string> &databases, bool throwOnSQLError)
+{
+    m_databases = databases;
+    m_throwOnSQLError = throwOnSQLError;
+
+    m_writer = openConnection(false);
+    if (!m_writer)
+        return false;
+
+    for (const auto &i : m_databases)
+    {
+        // Lets the maintenance task release free pages in small steps (only effective on new database files).
+        if (!m_writer->execute("PRAGMA `" + i.first + "`.auto_vacuum=INCREMENTAL;"))
+        {
+            APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Failed to set auto_vacuum on '%s'", i.first.c_str());
+        }
+
+        std::string journalMode;
+        if (!queryPragma(m_writer, "PRAGMA `" + i.first + "`.journal_mode=WAL;", &journalMode) || journalMode != "wal")
+        {
+            APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Failed to enable WAL mode on '%s' (journal_mode=%s)", i.first.c_str(), journalMode.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ConnectionPool::openReaders(size_t readers)
+{
+    if (readers == 0)
+        readers = 1;
+
+    for (size_t n = 0; n < readers; n++)
+    {
+        SQLConnector_SQLite3 *reader = openConnection(true);
+        if (!reader)
+            return false;
+        m_readers.push_back(reader);
+    }
+
+    std::lock_guard<std::mutex> lock(m_idleMutex);
+    m_idleReaders = m_readers;
+
+    APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Database pool ready: 1 writer, %zu reader connection(s)", m_readers.size());
+    return true;
+}
+
+ConnectionPool::Lease ConnectionPool::reader()
+{
+    auto waitStart = std::chrono::steady_clock::now();
+
+    m_waiting.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(m_idleMutex);
+    m_idleCond.wait(lock, [this] { return !m_idleReaders.empty(); });
+
+    SQLConnector_SQLite3 *connector = m_idleReaders.back();
+    m_idleReaders.pop_back();
+    lock.unlock();
+    m_waiting.fetch_sub(1, std::memory_order_relaxed);
+    m_busy.fetch_add(1, std::memory_order_relaxed);
+
+    Metrics::addDBWait(std::chrono::steady_clock::now() - waitStart);
+    return Lease(this, connector);
+}
+
+void ConnectionPool::release(SQLConnector_SQLite3 *connector)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+        m_idleReaders.push_back(connector);
+    }
+    m_busy.fetch_sub(1, std::memory_order_relaxed);
+    m_idleCond.notify_one();
+}
+
+SQLConnector_SQLite3 *ConnectionPool::openConnection(bool readOnly)
+{
+    auto *connector = new SQLConnector_SQLite3();
+
+    connector->setThrowCPPErrorOnQueryFailure(m_throwOnSQLError);
+
+    if (!connector->connectInMemory())
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Error, Failed to create in-memory SQLite3 database");
+        delete connector;
+        return nullptr;
+    }
+
+    for (const auto &i : m_databases)
+    {
+        if (!connector->attach(i.second, i.first))
+        {
+            APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Error, Failed to attach SQLite3 database file: '%s'", i.second.c_str());
+            delete connector;
+            return nullptr;
+        }
+    }
+
+    // Wait (instead of failing) while a WAL checkpoint or recovery holds the database lock.
+    if (!queryPragma(connector, "PRAGMA busy_timeout=5000;"))
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Error, Failed to set the SQLite3 busy timeout");
+        delete connector;
+        return nullptr;
+    }
+
+    // Reader connections must never write.
+    if (readOnly && !connector->execute("PRAGMA query_only=1;"))
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Error, Failed to set the SQLite3 reader connection as query only");
+        delete connector;
+        return nullptr;
+    }
+
+    return connector;
+}
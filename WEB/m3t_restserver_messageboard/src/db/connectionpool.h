@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Mantids30/DB_SQLite3/sqlconnector_sqlite3.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief SQLite3 connection pool: one dedicated writer connection and N reader connections
+ *
+ * Every connection is an in-memory database with the same set of database files attached
+ * (schema name -> file path). Attached files are switched to WAL mode, so readers work on
+ * their own snapshot and never block (or get blocked by) the writer.
+ *
+ * Statement preparation is done by SQLConnector (qSelect/execute prepare and finalize every
+ * statement and don't expose the sqlite3 handle), so prepared statements can't be kept per
+ * connection from here: that cache belongs to the DB_SQLite3 library. Meanwhile every statement
+ * a handler runs is parsed again on every call (e.g. postMessage: the INSERT ... RETURNING, the
+ * thread UPDATE and the ThreadIndex::fetch re-read), only the thread list skips SQL entirely
+ * (served from ThreadIndex).
+ */
+class ConnectionPool
+{
+public:
+    /**
+     * @brief Reader connection checked out from the pool, returned when destroyed.
+     *
+     * The time it was held is accounted as SQL time of the current request (see Metrics).
+     */
+    class Lease
+    {
+    public:
+        Lease(ConnectionPool *pool, Mantids30::Database::SQLConnector_SQLite3 *connector);
+        Lease(Lease &&other) noexcept;
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        ~Lease();
+
+        Mantids30::Database::SQLConnector_SQLite3 *operator->() const { return m_connector; }
+        Mantids30::Database::SQLConnector_SQLite3 *get() const { return m_connector; }
+
+    private:
+        ConnectionPool *m_pool;
+        Mantids30::Database::SQLConnector_SQLite3 *m_connector;
+        std::chrono::steady_clock::time_point m_acquiredAt;
+    };
+
+    ConnectionPool() = default;
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+    ~ConnectionPool();
+
+    /**
+     * @brief Open the writer connection and switch the attached files to WAL mode.
+     * @param databases schema name -> database file path
+     * @param throwOnSQLError terminate on query failure (DB.TerminateOnSQLError)
+     */
+    bool openWriter(const std::map<std::string, std::string> &databases, bool throwOnSQLError);
+
+    /**
+     * @brief Open the reader connections (call after the schema was created by the writer).
+     */
+    bool openReaders(size_t readers);
+
+    /**
+     * @brief Check out a reader connection, waits until one is available.
+     *
+     * The wait is accounted as database wait time of the current request (see Metrics).
+     */
+    Lease reader();
+
+    /**
+     * @brief Dedicated writer connection. Only used at startup (schema) and then by the WriteQueue.
+     */
+    Mantids30::Database::SQLConnector_SQLite3 *writer() const { return m_writer; }
+
+    size_t readersCount() const { return m_readers.size(); }
+
+    /**
+     * @brief Requests waiting for a reader connection, and reader connections checked out
+     */
+    size_t waitingReaders() const { return m_waiting.load(std::memory_order_relaxed); }
+    size_t busyReaders() const { return m_busy.load(std::memory_order_relaxed); }
+
+private:
+    Mantids30::Database::SQLConnector_SQLite3 *openConnection(bool readOnly);
+    void release(Mantids30::Database::SQLConnector_SQLite3 *connector);
+
+    std::map<std::string, std::string> m_databases;
+    bool m_throwOnSQLError = false;
+
+    Mantids30::Database::SQLConnector_SQLite3 *m_writer = nullptr;
+    std::vector<Mantids30::Database::SQLConnector_SQLite3 *> m_readers;
+
+    std::mutex m_idleMutex;
+    std::condition_variable m_idleCond;
+    std::vector<Mantids30::Database::SQLConnector_SQLite3 *> m_idleReaders;
+    std::atomic<size_t> m_waiting{0};
+    std::atomic<size_t> m_busy{0};
+};
@@ -0,0 +1,214 @@
+#include "maintenance.h"
+
+#include "../definitions/context.h"
+
+#include <Mantids30/Memory/a_allvars.h>
+#include <vector>
+
+using namespace Mantids30;
+using namespace Mantids30::Memory;
+
+#define MESSAGE_COLUMNS "`messageId`, `threadId`, `userId`, `content`, `ipAddress`, `userAgent`, `createdAt`, `editedAt`, `isDeleted`, `deletedAt`"
+#define THREAD_COLUMNS "`threadId`, `title`, `creatorUserId`, `createdAt`, `lastPostAt`, `isPinned`, `isLocked`, `messageCount`, `lastMessageId`, `lastPosterId`"
+
+// Rows are moved with a copy to mboard_archive then a delete from their database, in the same
+// transaction. SQLite does not commit attached WAL databases atomically: a crash during the commit
+// may leave the rows in both files (the copy replaces the archived one when the step runs again, so
+// the move is finished then) or in none of them (lost).
+#define ARCHIVE_INSERT "INSERT OR REPLACE INTO "
+
+// Runs the query and returns the ids as a JSON array (to be expanded with json_each).
+static std::string selectIds(SQLConnector_SQLite3 *db, const std::string &sql, const std::map<std::string, std::shared_ptr<Abstract::Var>> &inputs, std::vector<uint32_t> &ids)
+{
+    Abstract::UINT32 id;
+    SQLConnector::QueryInstance i = db->qSelect(sql, inputs, {&id});
+
+    std::string list;
+    while (i.getResultsOK() && i.query->step())
+    {
+        ids.push_back(id.getValue());
+        list += (list.empty() ? "[" : ",") + std::to_string(id.getValue());
+    }
+    return list + "]";
+}
+
+Maintenance::~Maintenance()
+{
+    stop();
+}
+
+void Maintenance::start(const Settings &settings)
+{
+    m_settings = settings;
+
+    // auto_vacuum can only be enabled on a new database (or with a full, offline VACUUM).
+    {
+        ConnectionPool::Lease db = g_ctx.dbPool.reader();
+        Abstract::STRING autoVacuum;
+        SQLConnector::QueryInstance i = db->qSelect("PRAGMA `mboard`.auto_vacuum;", {}, {&autoVacuum});
+        m_incrementalVacuum = i.getResultsOK() && i.query->step() && autoVacuum.getValue() == "2";
+    }
+    if (!m_incrementalVacuum)
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_WARN, "Incremental vacuum is not enabled on this database, free pages will be reused but not released (run VACUUM offline to enable it)");
+    }
+
+    m_running = true;
+    m_thread = std::thread(&Maintenance::run, this);
+
+    APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Database maintenance started (every %us, deleted messages retention: %u days, idle threads archived after: %u days)",
+                  m_settings.intervalSeconds, m_settings.deletedRetentionDays, m_settings.archiveIdleThreadsDays);
+}
+
+void Maintenance::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool Maintenance::wait(uint32_t ms)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return !m_cond.wait_for(lock, std::chrono::milliseconds(ms), [this] { return !m_running; });
+}
+
+void Maintenance::run()
+{
+    while (wait(m_settings.intervalSeconds * 1000))
+    {
+        size_t purged = 0, archived = 0, vacuumed = 0, n;
+
+        bool running = true;
+        while (running && (n = purgeDeletedMessagesStep()) != 0)
+        {
+            purged += n;
+            running = wait(m_settings.stepDelayMS);
+        }
+
+        while (running && m_settings.archiveIdleThreadsDays && (n = archiveIdleThreadsStep()) != 0)
+        {
+            archived += n;
+            running = wait(m_settings.stepDelayMS);
+        }
+
+        while (running && m_incrementalVacuum && (n = vacuumStep()) != 0)
+        {
+            vacuumed += n;
+            running = wait(m_settings.stepDelayMS);
+        }
+
+        APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Database maintenance: %zu deleted message(s) purged, %zu idle thread(s) archived, %zu page(s) released", purged, archived, vacuumed);
+    }
+}
+
+size_t Maintenance::purgeDeletedMessagesStep()
+{
+    size_t moved = 0;
+    g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &) -> bool
+        {
+            // Messages deleted before deletedAt was recorded use their creation time.
+            std::vector<uint32_t> ids;
+            std::string idList = selectIds(db,
+                                           "SELECT `messageId` FROM `mboard`.`messages` WHERE `isDeleted`=1 AND COALESCE(`deletedAt`, `createdAt`) < datetime('now', :retention) "
+                                           "ORDER BY `messageId` LIMIT :rows;",
+                                           {{":retention", MAKE_VAR(STRING, "-" + std::to_string(m_settings.deletedRetentionDays) + " days")},
+                                            {":rows", MAKE_VAR(UINT32, m_settings.messagesPerStep)}},
+                                           ids);
+            if (ids.empty())
+                return true;
+
+            if (!db->execute(ARCHIVE_INSERT "`mboard_archive`.`messages` (" MESSAGE_COLUMNS ") SELECT " MESSAGE_COLUMNS " FROM `mboard`.`messages` "
+                             "WHERE `messageId` IN (SELECT `value` FROM json_each(:ids));",
+                             {{":ids", MAKE_VAR(STRING, idList)}})
+                || !db->execute("DELETE FROM `mboard`.`messages` WHERE `messageId` IN (SELECT `value` FROM json_each(:ids));", {{":ids", MAKE_VAR(STRING, idList)}}))
+            {
+                APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Failed to purge deleted messages");
+                return false;
+            }
+
+            moved = ids.size();
+            return true;
+        });
+    return moved;
+}
+
+size_t Maintenance::archiveIdleThreadsStep()
+{
+    std::vector<uint32_t> ids;
+    size_t moved = 0;
+    g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &) -> bool
+        {
+            // Range read over idx_threads_order (isPinned=0, lastPostAt<...).
+            std::string idList = selectIds(db,
+                                           "SELECT `threadId` FROM `mboard`.`threads` WHERE `isPinned`=0 AND `lastPostAt` < datetime('now', :idle) "
+                                           "ORDER BY `lastPostAt` LIMIT :threads;",
+                                           {{":idle", MAKE_VAR(STRING, "-" + std::to_string(m_settings.archiveIdleThreadsDays) + " days")},
+                                            {":threads", MAKE_VAR(UINT32, m_settings.threadsPerStep)}},
+                                           ids);
+            if (ids.empty())
+                return true;
+
+            if (!db->execute(ARCHIVE_INSERT "`mboard_archive`.`messages` (" MESSAGE_COLUMNS ") SELECT " MESSAGE_COLUMNS " FROM `mboard`.`messages` "
+                             "WHERE `threadId` IN (SELECT `value` FROM json_each(:ids));",
+                             {{":ids", MAKE_VAR(STRING, idList)}})
+                || !db->execute("DELETE FROM `mboard`.`messages` WHERE `threadId` IN (SELECT `value` FROM json_each(:ids));", {{":ids", MAKE_VAR(STRING, idList)}})
+                || !db->execute(ARCHIVE_INSERT "`mboard_archive`.`threads` (" THREAD_COLUMNS ") SELECT " THREAD_COLUMNS " FROM `mboard`.`threads` "
+                                "WHERE `threadId` IN (SELECT `value` FROM json_each(:ids));",
+                                {{":ids", MAKE_VAR(STRING, idList)}})
+                || !db->execute("DELETE FROM `mboard`.`threads` WHERE `threadId` IN (SELECT `value` FROM json_each(:ids));", {{":ids", MAKE_VAR(STRING, idList)}}))
+            {
+                APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Failed to archive idle threads");
+                return false;
+            }
+
+            moved = ids.size();
+            return true;
+        },
+        [&]
+        {
+            // Archived threads leave the thread list (published with the batch), ETags must not match them anymore.
+            g_ctx.threadIndex.remove(ids);
+            for (uint32_t threadId : ids)
+                g_ctx.versions.bumpThread(threadId);
+        });
+    return moved;
+}
+
+size_t Maintenance::vacuumStep()
+{
+    size_t released = 0;
+    g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &) -> bool
+        {
+            auto freePages = [db]() -> size_t
+            {
+                Abstract::UINT32 pages;
+                SQLConnector::QueryInstance i = db->qSelect("PRAGMA `mboard`.freelist_count;", {}, {&pages});
+                return i.getResultsOK() && i.query->step() ? pages.getValue() : 0;
+            };
+
+            size_t before = freePages();
+            if (before == 0)
+                return true;
+
+            if (!db->execute("PRAGMA `mboard`.incremental_vacuum(" + std::to_string(m_settings.vacuumPagesPerStep) + ");"))
+            {
+                APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Failed to run the incremental vacuum");
+                return false;
+            }
+
+            size_t after = freePages();
+            released = before > after ? before - after : 0;
+            return true;
+        });
+    return released;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Background compaction of the message board database
+ *
+ * On every run, soft-deleted messages past their retention and idle (not pinned) threads with
+ * their messages are moved from mboard to mboard_archive, then the free pages of mboard are
+ * returned to the file system with incremental vacuum. All the work goes through the write
+ * queue in small steps, so request writes are never held behind a long transaction.
+ */
+class Maintenance
+{
+public:
+    struct Settings
+    {
+        // Time between two runs
+        uint32_t intervalSeconds = 3600;
+        // Soft-deleted messages are kept in mboard for this long after their deletion
+        uint32_t deletedRetentionDays = 30;
+        // Threads without new posts for this long are archived (0: never). Off by default: archived
+        // threads are no longer listed nor readable through the API.
+        uint32_t archiveIdleThreadsDays = 0;
+        // Work done by every step (a single write intent)
+        uint32_t messagesPerStep = 500;
+        uint32_t threadsPerStep = 20;
+        uint32_t vacuumPagesPerStep = 256;
+        // Pause between two steps
+        uint32_t stepDelayMS = 50;
+    };
+
+    Maintenance() = default;
+    Maintenance(const Maintenance &) = delete;
+    Maintenance &operator=(const Maintenance &) = delete;
+    ~Maintenance();
+
+    /**
+     * @brief Start the maintenance thread (the write queue must be running)
+     */
+    void start(const Settings &settings);
+
+    /**
+     * @brief Stop the maintenance thread (the current step is finished first)
+     */
+    void stop();
+
+private:
+    void run();
+
+    /**
+     * @brief Sleep, or return false if the task is being stopped
+     */
+    bool wait(uint32_t ms);
+
+    /**
+     * @brief Each step returns the number of rows/pages processed (0 when there is nothing left to do)
+     */
+    size_t purgeDeletedMessagesStep();
+    size_t archiveIdleThreadsStep();
+    size_t vacuumStep();
+
+    Settings m_settings;
+    bool m_incrementalVacuum = false;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_running = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,239 @@
+#include "writequeue.h"
+
+#include "../definitions/context.h"
+#include "../metrics/metrics.h"
+
+#include <Mantids30/Memory/a_allvars.h>
+
+using namespace Mantids30;
+using namespace Mantids30::Memory;
+using namespace Mantids30::Network::Protocols;
+
+WriteQueue::~WriteQueue()
+{
+    stop();
+}
+
+bool WriteQueue::start(SQLConnector_SQLite3 *writer, size_t maxBatch, uint32_t maxDelayMS)
+{
+    m_writer = writer;
+    m_maxBatch = maxBatch ? maxBatch : 1;
+    m_maxDelayMS = maxDelayMS;
+
+    if (!checkTransactions())
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "The database connector does not roll back/commit transactions as expected, the write queue can't be used");
+        return false;
+    }
+
+    m_running = true;
+    m_thread = std::thread(&WriteQueue::run, this);
+
+    APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Database write queue started (max batch: %zu, max delay: %ums)", m_maxBatch, m_maxDelayMS);
+    return true;
+}
+
+bool WriteQueue::checkTransactions()
+{
+    // Same statements as commitBatch(), on a temporary table: the rolled back savepoint and the rolled
+    // back transaction must leave nothing, the released savepoint and the commit must keep their row.
+    bool ok = m_writer->execute("CREATE TEMP TABLE IF NOT EXISTS `writequeue_check` (`step` INTEGER NOT NULL);")
+              && m_writer->execute("DELETE FROM `temp`.`writequeue_check`;")
+              && m_writer->execute("BEGIN IMMEDIATE;")
+              && m_writer->execute("SAVEPOINT `intent`;")
+              && m_writer->execute("INSERT INTO `temp`.`writequeue_check` (`step`) VALUES (1);")
+              && m_writer->execute("ROLLBACK TO `intent`;")
+              && m_writer->execute("RELEASE `intent`;")
+              && m_writer->execute("SAVEPOINT `intent`;")
+              && m_writer->execute("INSERT INTO `temp`.`writequeue_check` (`step`) VALUES (2);")
+              && m_writer->execute("RELEASE `intent`;")
+              && m_writer->execute("COMMIT;")
+              && m_writer->execute("BEGIN IMMEDIATE;")
+              && m_writer->execute("INSERT INTO `temp`.`writequeue_check` (`step`) VALUES (3);")
+              && m_writer->execute("ROLLBACK;");
+
+    std::string steps;
+    if (ok)
+    {
+        Abstract::STRING result;
+        SQLConnector::QueryInstance i = m_writer->qSelect("SELECT COALESCE(group_concat(`step`), '') FROM `temp`.`writequeue_check`;", {}, {&result});
+        ok = i.getResultsOK() && i.query->step();
+        steps = result.getValue();
+    }
+    else
+    {
+        // Whatever was left open by the failed statement.
+        m_writer->execute("ROLLBACK;");
+    }
+    m_writer->execute("DROP TABLE IF EXISTS `temp`.`writequeue_check`;");
+
+    if (ok && steps != "2")
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Transaction check: rows left '%s' (expected '2')", steps.c_str());
+        ok = false;
+    }
+    return ok;
+}
+
+void WriteQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+API::APIReturn WriteQueue::submit(Intent intent, std::function<void()> onCommit)
+{
+    auto pending = std::make_unique<Pending>();
+    pending->intent = std::move(intent);
+    pending->onCommit = std::move(onCommit);
+    std::future<API::APIReturn> result = pending->done.get_future();
+
+    // Set by the writer thread when the intent starts running (before its result is delivered).
+    auto queuedAt = std::chrono::steady_clock::now();
+    auto startedAt = queuedAt;
+    pending->startedAt = &startedAt;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+        {
+            return API::APIReturn(HTTP::Status::S_503_SERVICE_UNAVAILABLE, "unavailable", "Database writer is not running");
+        }
+        m_queue.push_back(std::move(pending));
+        m_depth.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_cond.notify_all();
+
+    API::APIReturn committed = result.get();
+    m_depth.fetch_sub(1, std::memory_order_relaxed);
+    Metrics::addDBWait(startedAt - queuedAt);
+    Metrics::addSQL(std::chrono::steady_clock::now() - startedAt);
+    return committed;
+}
+
+void WriteQueue::run()
+{
+    for (;;)
+    {
+        std::deque<std::unique_ptr<Pending>> batch;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return !m_queue.empty() || !m_running; });
+
+            if (m_queue.empty())
+                return; // stopped and drained.
+
+            // Give other writers the chance to join this commit.
+            if (m_maxDelayMS && m_queue.size() < m_maxBatch && m_running)
+            {
+                m_cond.wait_for(lock, std::chrono::milliseconds(m_maxDelayMS), [this] { return m_queue.size() >= m_maxBatch || !m_running; });
+            }
+
+            while (!m_queue.empty() && batch.size() < m_maxBatch)
+            {
+                batch.push_back(std::move(m_queue.front()));
+                m_queue.pop_front();
+            }
+        }
+
+        commitBatch(batch);
+    }
+}
+
+void WriteQueue::commitBatch(std::deque<std::unique_ptr<Pending>> &batch)
+{
+    auto failAll = [&batch](const char *message)
+    {
+        for (auto &pending : batch)
+            pending->done.set_value(API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", message));
+    };
+
+    if (!m_writer->execute("BEGIN IMMEDIATE;"))
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Failed to begin the write transaction");
+        failAll("DB Failed");
+        return;
+    }
+
+    for (auto &pending : batch)
+    {
+        *pending->startedAt = std::chrono::steady_clock::now();
+
+        // Each intent runs in its own savepoint: a failed intent does not abort the others.
+        bool ok = m_writer->execute("SAVEPOINT `intent`;");
+        if (ok)
+        {
+            try
+            {
+                ok = pending->intent(m_writer, pending->result);
+            }
+            catch (const std::exception &e)
+            {
+                APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Write intent failed: %s", e.what());
+                pending->result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+                ok = false;
+            }
+            catch (...)
+            {
+                // Other exception types: the writer thread must survive them too, or every caller would wait forever.
+                APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Write intent failed");
+                pending->result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+                ok = false;
+            }
+
+            if (!ok)
+                m_writer->execute("ROLLBACK TO `intent`;");
+            m_writer->execute("RELEASE `intent`;");
+            pending->ok = ok;
+        }
+        else
+        {
+            pending->result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+        }
+    }
+
+    if (!m_writer->execute("COMMIT;"))
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Failed to commit a batch of %zu write(s)", batch.size());
+        m_writer->execute("ROLLBACK;");
+        failAll("DB Failed committing");
+        return;
+    }
+
+    // The callbacks run while their caller still waits (they may use its state), the callers are
+    // released once the changes of the whole batch are visible.
+    for (auto &pending : batch)
+    {
+        if (pending->ok && pending->onCommit)
+            runCallback(pending->onCommit);
+    }
+    if (m_onBatchCommitted)
+        runCallback(m_onBatchCommitted);
+
+    for (auto &pending : batch)
+        pending->done.set_value(std::move(pending->result));
+}
+
+void WriteQueue::runCallback(const std::function<void()> &callback)
+{
+    // A failing callback must not keep the callers of the batch waiting.
+    try
+    {
+        callback();
+    }
+    catch (const std::exception &e)
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Commit callback failed: %s", e.what());
+    }
+    catch (...)
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Commit callback failed");
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Mantids30/DB_SQLite3/sqlconnector_sqlite3.h>
+#include <Mantids30/Protocol_HTTP/api_return.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Single-writer queue with group commit
+ *
+ * Handlers submit write intents, a dedicated thread (the only user of the writer connection)
+ * runs them in batches: one transaction per batch, one savepoint per intent. The caller is
+ * released once the batch that contains its intent has been committed, so the durability of
+ * every request is kept while the commit (fsync) cost is shared by the whole batch.
+ *
+ * The transaction control statements (BEGIN, SAVEPOINT, ROLLBACK TO, RELEASE, COMMIT, ROLLBACK) are
+ * plain statements run through SQLConnector::execute(), which does not document them as supported:
+ * start() checks on the writer connection that they behave as expected and refuses to start otherwise.
+ * Since the writer connection is used by this thread only, no database lock (dbShrLock) is needed.
+ */
+class WriteQueue
+{
+public:
+    /**
+     * @brief Write intent, executed on the writer connection inside the batch transaction.
+     * @param db writer connection
+     * @param result API response for the caller
+     * @return false to roll back the changes of this intent only (result should describe the error)
+     */
+    using Intent = std::function<bool(Mantids30::Database::SQLConnector_SQLite3 *db, Mantids30::API::APIReturn &result)>;
+
+    WriteQueue() = default;
+    WriteQueue(const WriteQueue &) = delete;
+    WriteQueue &operator=(const WriteQueue &) = delete;
+    ~WriteQueue();
+
+    /**
+     * @brief Check the transaction support of the writer connection, then start the writer thread
+     * @param writer writer connection (owned by the pool, used exclusively by this queue from now on)
+     * @param maxBatch maximum number of intents per transaction
+     * @param maxDelayMS time to wait for more intents before committing a non-full batch (0: commit as soon as possible)
+     * @return false if the connection does not roll back/commit as expected (the thread is not started)
+     */
+    bool start(Mantids30::Database::SQLConnector_SQLite3 *writer, size_t maxBatch, uint32_t maxDelayMS);
+
+    /**
+     * @brief Finish the pending intents and stop the writer thread.
+     */
+    void stop();
+
+    /**
+     * @brief Set the function called (from the writer thread) once per committed batch, after the
+     * onCommit callbacks of its intents and before their callers are released. Set it before start().
+     */
+    void setOnBatchCommitted(std::function<void()> onBatchCommitted) { m_onBatchCommitted = std::move(onBatchCommitted); }
+
+    /**
+     * @brief Queue the intent and wait until its batch is committed.
+     *
+     * The time in the queue is accounted as database wait time of the current request, the time
+     * from the start of the intent to the commit as its SQL time (see Metrics).
+     * @param onCommit called (from the writer thread) once the changes of a successful intent are committed
+     */
+    Mantids30::API::APIReturn submit(Intent intent, std::function<void()> onCommit = nullptr);
+
+    /**
+     * @brief Submitted intents not committed yet (queued or in the running batch)
+     */
+    size_t depth() const { return m_depth.load(std::memory_order_relaxed); }
+
+private:
+    struct Pending
+    {
+        Intent intent;
+        std::function<void()> onCommit;
+        bool ok = false;
+        Mantids30::API::APIReturn result;
+        std::promise<Mantids30::API::APIReturn> done;
+        // Start time of the intent (owned by the waiting caller, set by the writer thread)
+        std::chrono::steady_clock::time_point *startedAt = nullptr;
+    };
+
+    bool checkTransactions();
+    void run();
+    void commitBatch(std::deque<std::unique_ptr<Pending>> &batch);
+    static void runCallback(const std::function<void()> &callback);
+
+    Mantids30::Database::SQLConnector_SQLite3 *m_writer = nullptr;
+    size_t m_maxBatch = 128;
+    uint32_t m_maxDelayMS = 0;
+    std::function<void()> m_onBatchCommitted;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::unique_ptr<Pending>> m_queue;
+    bool m_running = false;
+    std::thread m_thread;
+    std::atomic<size_t> m_depth{0};
+};
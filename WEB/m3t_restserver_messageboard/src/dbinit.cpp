@@ -3,26 +3,117 @@
 #include "definitions/context.h"
 #include "definitions/database.h"
 #include "config.h"
+#include <Mantids30/Memory/a_allvars.h>
+#include <algorithm>
 #include <filesystem>
+#include <set>
+#include <thread>
 
 #include <sys/stat.h>
 
 using namespace Mantids30;
+using namespace Mantids30::Memory;
+
+// Once per committed batch: the thread list changes of the batch are published together, before
+// the ETag changes (a page is never tagged newer than its content).
+static void threadListCommitted()
+{
+    if (g_ctx.threadIndex.publishStaged())
+        g_ctx.versions.bumpThreadList();
+}
 
 bool initTables()
 {
-    bool success = true;
     for (const auto &sql : getSQLCreateStatements())
     {
-        if (!g_ctx.dbConnector->execute(sql.data()))
+        if (!g_ctx.dbPool.writer()->execute(sql.data()))
         {
             APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Failed to execute SQL: '%s'", std::string(sql).c_str());
-            success = false;
-            break;
+            return false;
         }
     }
+    return true;
+}
 
-    return success;
+// Adds the columns that databases created by previous versions don't have yet.
+bool migrateTables(bool &columnsAdded)
+{
+    columnsAdded = false;
+    for (const auto &[table, column, definition] : getSQLAddedColumns())
+    {
+        // Read and closed before the ALTER (no other query may run while a QueryInstance exists).
+        std::set<std::string> columns;
+        {
+            Abstract::STRING name;
+            SQLConnector::QueryInstance i = g_ctx.dbPool.writer()->qSelect("SELECT `name` FROM pragma_table_info(:table, 'mboard');", {{":table", MAKE_VAR(STRING, table)}}, {&name});
+            if (!i.getResultsOK())
+            {
+                APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Failed to read the columns of table '%s'", table.c_str());
+                return false;
+            }
+            while (i.query->step())
+                columns.insert(name.getValue());
+        }
+
+        // New tables are created with all their columns.
+        if (columns.empty() || columns.count(column))
+            continue;
+
+        APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Adding column '%s' to table '%s'", column.c_str(), table.c_str());
+        if (!g_ctx.dbPool.writer()->execute("ALTER TABLE `mboard`.`" + table + "` ADD COLUMN `" + column + "` " + definition + ";"))
+        {
+            APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Failed to add column '%s' to table '%s'", column.c_str(), table.c_str());
+            return false;
+        }
+        columnsAdded = true;
+    }
+    return true;
+}
+
+// One-shot computation of the per-thread counters (postMessage/deleteMessage keep them up to date after this).
+bool rebuildThreadCounters()
+{
+    APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Rebuilding the thread counters...");
+    if (!g_ctx.dbPool.writer()->execute("UPDATE `mboard`.`threads` SET "
+                                        "`messageCount`=(SELECT COUNT(*) FROM `mboard`.`messages` m WHERE m.`threadId`=`threads`.`threadId` AND m.`isDeleted`=0), "
+                                        "(`lastMessageId`, `lastPosterId`)=(SELECT m.`messageId`, m.`userId` FROM `mboard`.`messages` m "
+                                        "WHERE m.`threadId`=`threads`.`threadId` AND m.`isDeleted`=0 ORDER BY m.`messageId` DESC LIMIT 1);"))
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Failed to rebuild the thread counters");
+        return false;
+    }
+    return true;
+}
+
+// The search indexes are kept in sync by triggers, existing databases are indexed once here.
+static bool initSearchIndex(const std::string &index, const std::string &fill)
+{
+    Abstract::BOOL isEmpty;
+    {
+        // Closed before the fill (no other query may run while a QueryInstance exists).
+        SQLConnector::QueryInstance i = g_ctx.dbPool.writer()->qSelect("SELECT NOT EXISTS(SELECT 1 FROM `mboard`.`" + index + "_docsize`);", {}, {&isEmpty});
+        if (!i.getResultsOK() || !i.query->step())
+        {
+            APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Failed to check the search index '%s'", index.c_str());
+            return false;
+        }
+    }
+    if (!isEmpty.getValue())
+        return true;
+
+    APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Building the search index '%s'...", index.c_str());
+    if (!g_ctx.dbPool.writer()->execute(fill))
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Failed to build the search index '%s'", index.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool initSearchIndexes()
+{
+    return initSearchIndex("messages_fts", "INSERT INTO `mboard`.`messages_fts`(rowid, `content`) SELECT `messageId`, `content` FROM `mboard`.`messages` WHERE `isDeleted`=0;")
+           && initSearchIndex("threads_fts", "INSERT INTO `mboard`.`threads_fts`(rowid, `title`) SELECT `threadId`, `title` FROM `mboard`.`threads`;");
 }
 
 bool initDatabase()
@@ -57,17 +148,6 @@ bool initDatabase()
         return false;
     }
 
-    g_ctx.dbConnector = new SQLConnector_SQLite3();
-
-    g_ctx.dbConnector->setThrowCPPErrorOnQueryFailure(g_ctx.config.get<bool>("DB.TerminateOnSQLError", false));
-
-    if (!g_ctx.dbConnector->connectInMemory())
-    {
-        APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Error, Failed to create in-memory SQLite3 database");
-        delete g_ctx.dbConnector;
-        return false;
-    }
-
     auto createFileIfNotExists = [](const std::string &path) -> bool
     {
         struct stat buffer;
@@ -88,27 +168,71 @@ bool initDatabase()
         return true;
     };
 
+    std::map<std::string, std::string> databases;
     for (const auto & i : databaseDefinitions())
     {
         std::string messageBoardDBPath = dbDirectory + "/" + i.second;
 
         if (!createFileIfNotExists(messageBoardDBPath))
         {
-            delete g_ctx.dbConnector;
             return false;
         }
 
-        if (!g_ctx.dbConnector->attach(messageBoardDBPath, i.first))
-        {
-            APP_LOG->log0(__func__, Logs::LEVEL_CRITICAL, "Error, Failed to attach SQLite3 database file: '%s'", messageBoardDBPath.c_str());
-            delete g_ctx.dbConnector;
-            return false;
-        }
-        else
-        {
-            APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Opened SQLite3 database file: '%s' into '%s'", messageBoardDBPath.c_str(),i.first.c_str());
-        }
+        databases[i.first] = messageBoardDBPath;
+        APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Using SQLite3 database file: '%s' as '%s'", messageBoardDBPath.c_str(),i.first.c_str());
+    }
+
+    // The writer connection creates the schema, then the readers are attached to the (WAL) files.
+    if (!g_ctx.dbPool.openWriter(databases, g_ctx.config.get<bool>("DB.TerminateOnSQLError", false)))
+    {
+        return false;
+    }
+
+    bool columnsAdded;
+    if (!migrateTables(columnsAdded) || !initTables() || !initSearchIndexes())
+    {
+        return false;
+    }
+
+    if (columnsAdded && !rebuildThreadCounters())
+    {
+        return false;
+    }
+
+    // From now on kept up to date by the writes (see threadListChanged)
+    if (!g_ctx.threadIndex.load(g_ctx.dbPool.writer()))
+    {
+        return false;
+    }
+
+    size_t readConnections = g_ctx.config.get<size_t>("DB.ReadConnections", 0);
+    if (readConnections == 0)
+    {
+        readConnections = std::max(1u, std::thread::hardware_concurrency());
     }
 
-    return initTables();
+    if (!g_ctx.dbPool.openReaders(readConnections))
+    {
+        return false;
+    }
+
+    g_ctx.dbWriteQueue.setOnBatchCommitted(&threadListCommitted);
+    if (!g_ctx.dbWriteQueue.start(g_ctx.dbPool.writer(), g_ctx.config.get<size_t>("DB.WriteQueue.MaxBatch", 128), g_ctx.config.get<uint32_t>("DB.WriteQueue.MaxDelayMS", 0)))
+    {
+        return false;
+    }
+
+    if (g_ctx.config.get<bool>("DB.Maintenance.Enabled", true))
+    {
+        Maintenance::Settings maintenance;
+        maintenance.intervalSeconds = std::max(1u, g_ctx.config.get<uint32_t>("DB.Maintenance.IntervalSeconds", maintenance.intervalSeconds));
+        maintenance.deletedRetentionDays = g_ctx.config.get<uint32_t>("DB.Maintenance.DeletedRetentionDays", maintenance.deletedRetentionDays);
+        maintenance.archiveIdleThreadsDays = g_ctx.config.get<uint32_t>("DB.Maintenance.ArchiveIdleThreadsDays", maintenance.archiveIdleThreadsDays);
+        maintenance.messagesPerStep = std::max(1u, g_ctx.config.get<uint32_t>("DB.Maintenance.MessagesPerStep", maintenance.messagesPerStep));
+        maintenance.threadsPerStep = std::max(1u, g_ctx.config.get<uint32_t>("DB.Maintenance.ThreadsPerStep", maintenance.threadsPerStep));
+        maintenance.vacuumPagesPerStep = std::max(1u, g_ctx.config.get<uint32_t>("DB.Maintenance.VacuumPagesPerStep", maintenance.vacuumPagesPerStep));
+        maintenance.stepDelayMS = g_ctx.config.get<uint32_t>("DB.Maintenance.StepDelayMS", maintenance.stepDelayMS);
+        g_ctx.dbMaintenance.start(maintenance);
+    }
+    return true;
 }
@@ -25,6 +25,10 @@ Json::Value appScopes()
       {
         "id": "EDITOR",
         "description": "Administrative access to lock/pin threads"
+      },
+      {
+        "id": "METRICS",
+        "description": "Read access to the server metrics"
       }
     ]
     )");
@@ -44,11 +48,12 @@ Json::Value appRoles()
       },
       {
         "id": "BOARDADMIN",
-        "description": "Have access to READER+WRITER+EDITOR",
+        "description": "Have access to READER+WRITER+EDITOR+METRICS",
         "scopes": [
           "READER",
           "WRITER",
-          "EDITOR"
+          "EDITOR",
+          "METRICS"
         ]
       }
     ]
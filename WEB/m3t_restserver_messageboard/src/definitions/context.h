@@ -1,9 +1,17 @@
 #pragma once
 
 
+#include "../cache/threadindex.h"
+#include "../cache/versiontracker.h"
+#include "../db/connectionpool.h"
+#include "../db/maintenance.h"
+#include "../db/writequeue.h"
+#include "../events/messageevents.h"
+#include "../logging/requestlog.h"
+#include "../metrics/metrics.h"
+#include "../ratelimit/ratelimiter.h"
 #include <Mantids30/DB_SQLite3/sqlconnector_sqlite3.h>
 #include <boost/property_tree/ptree_fwd.hpp>
-#include <Mantids30/Threads/lock_shared.h>
 #include <Mantids30/Config_Builder/program_logs.h>
 #include <memory>
 #include <string>
@@ -26,9 +34,31 @@ struct AppContext
     std::shared_ptr<Logs::AppLog> appLog;
     std::shared_ptr<Logs::RPCLog> rpcLog;
 
-    Mantids30::Threads::Sync::Mutex_Shared dbShrLock;
+    ConnectionPool dbPool;
 
-    SQLConnector_SQLite3 *dbConnector = nullptr;
+    // Owns the writer connection: every database change goes through this queue.
+    WriteQueue dbWriteQueue;
+
+    // Background purge/archive/vacuum of the database (through dbWriteQueue)
+    Maintenance dbMaintenance;
+
+    // Current version of the thread list, read by GET /api/v1/threads without touching the database
+    ThreadIndex threadIndex;
+
+    // ETag versions of the thread list and of every thread
+    VersionTracker versions;
+
+    // Recent message changes per thread (GET /api/v1/messages/events)
+    MessageEvents messageEvents{256, 65536};
+
+    // Latency histograms and response counters of every endpoint (GET /api/v1/metrics)
+    Metrics metrics;
+
+    // Per client IP and per user request limits, checked before the handlers
+    RateLimiter rateLimiter;
+
+    // Request lines of the endpoint handlers (buffered per thread, written by a background thread)
+    RequestLog requestLog;
 };
 
 extern AppContext g_ctx;
@@ -2,12 +2,27 @@
 
 #include <map>
 #include <string>
+#include <tuple>
 #include <vector>
 
 std::map<std::string,std::string> databaseDefinitions()
 {
     return {
-            { "mboard","message_board.db" }
+            { "mboard","message_board.db" },
+            // Purged and archived rows (moved out of mboard by the maintenance task)
+            { "mboard_archive","message_board_archive.db" }
+           };
+}
+
+// Columns added to existing tables after their creation: { table, column, definition }
+// (databases created before are migrated with ALTER TABLE before running the create statements)
+std::vector<std::tuple<std::string, std::string, std::string>> getSQLAddedColumns()
+{
+    return {
+            { "threads", "messageCount",  "INTEGER NOT NULL DEFAULT 0" },
+            { "threads", "lastMessageId", "INTEGER DEFAULT NULL" },
+            { "threads", "lastPosterId",  "VARCHAR(256) DEFAULT NULL" },
+            { "messages", "deletedAt",    "DATETIME DEFAULT NULL" }
            };
 }
 
@@ -22,7 +37,10 @@ std::vector<std::string_view> getSQLCreateStatements()
             `createdAt`         DATETIME        NOT NULL DEFAULT CURRENT_TIMESTAMP,
             `lastPostAt`        DATETIME        NOT NULL DEFAULT CURRENT_TIMESTAMP,
             `isPinned`          BOOLEAN         NOT NULL DEFAULT FALSE,
-            `isLocked`          BOOLEAN         NOT NULL DEFAULT FALSE
+            `isLocked`          BOOLEAN         NOT NULL DEFAULT FALSE,
+            `messageCount`      INTEGER         NOT NULL DEFAULT 0,
+            `lastMessageId`     INTEGER         DEFAULT NULL,
+            `lastPosterId`      VARCHAR(256)    DEFAULT NULL
         );)",
 
     // Table for messages/posts
@@ -36,12 +54,84 @@ std::vector<std::string_view> getSQLCreateStatements()
             `createdAt`         DATETIME        NOT NULL DEFAULT CURRENT_TIMESTAMP,
             `editedAt`          DATETIME        DEFAULT NULL,
             `isDeleted`         BOOLEAN         NOT NULL DEFAULT FALSE,
+            `deletedAt`         DATETIME        DEFAULT NULL,
             FOREIGN KEY (`threadId`) REFERENCES `threads`(`threadId`)
         );)",
 
     // Indexes for performance
-    R"(CREATE INDEX IF NOT EXISTS `mboard`.`idx_threads_lastpost` ON `threads`(`lastPostAt` DESC);)",
+    // Listing order (isPinned DESC, lastPostAt DESC, threadId DESC): loading the thread index and
+    // finding the idle threads. Key columns only, the listing itself is served from memory.
+    R"(CREATE INDEX IF NOT EXISTS `mboard`.`idx_threads_order` ON `threads`(`isPinned` DESC, `lastPostAt` DESC, `threadId` DESC);)",
+    // Superseded by idx_threads_order
+    R"(DROP INDEX IF EXISTS `mboard`.`idx_threads_lastpost`;)",
+    R"(DROP INDEX IF EXISTS `mboard`.`idx_threads_listing`;)",
+    R"(DROP INDEX IF EXISTS `mboard`.`idx_threads_page`;)",
     R"(CREATE INDEX IF NOT EXISTS `mboard`.`idx_messages_thread` ON `messages`(`threadId`, `createdAt`);)",
-    R"(CREATE INDEX IF NOT EXISTS `mboard`.`idx_messages_user` ON `messages`(`userId`);)"
+    // Partial index over live messages for the paginated message listing
+    R"(CREATE INDEX IF NOT EXISTS `mboard`.`idx_messages_live` ON `messages`(`threadId`, `messageId`) WHERE `isDeleted`=0;)",
+    R"(CREATE INDEX IF NOT EXISTS `mboard`.`idx_messages_user` ON `messages`(`userId`);)",
+    // Partial index over soft-deleted messages for the maintenance purge
+    R"(CREATE INDEX IF NOT EXISTS `mboard`.`idx_messages_deleted` ON `messages`(`messageId`) WHERE `isDeleted`=1;)",
+
+    // Archive: same rows, moved here from mboard by the maintenance task
+    R"(CREATE TABLE IF NOT EXISTS `mboard_archive`.`threads` (
+            `threadId`          INTEGER         PRIMARY KEY,
+            `title`             VARCHAR(256)    NOT NULL,
+            `creatorUserId`     VARCHAR(256)    NOT NULL,
+            `createdAt`         DATETIME        NOT NULL,
+            `lastPostAt`        DATETIME        NOT NULL,
+            `isPinned`          BOOLEAN         NOT NULL,
+            `isLocked`          BOOLEAN         NOT NULL,
+            `messageCount`      INTEGER         NOT NULL,
+            `lastMessageId`     INTEGER         DEFAULT NULL,
+            `lastPosterId`      VARCHAR(256)    DEFAULT NULL,
+            `archivedAt`        DATETIME        NOT NULL DEFAULT CURRENT_TIMESTAMP
+        );)",
+    R"(CREATE TABLE IF NOT EXISTS `mboard_archive`.`messages` (
+            `messageId`         INTEGER         PRIMARY KEY,
+            `threadId`          INTEGER         NOT NULL,
+            `userId`            VARCHAR(256)    NOT NULL,
+            `content`           TEXT            NOT NULL,
+            `ipAddress`         VARCHAR(45)     NOT NULL,
+            `userAgent`         VARCHAR(512)    DEFAULT NULL,
+            `createdAt`         DATETIME        NOT NULL,
+            `editedAt`          DATETIME        DEFAULT NULL,
+            `isDeleted`         BOOLEAN         NOT NULL,
+            `deletedAt`         DATETIME        DEFAULT NULL,
+            `archivedAt`        DATETIME        NOT NULL DEFAULT CURRENT_TIMESTAMP
+        );)",
+    R"(CREATE INDEX IF NOT EXISTS `mboard_archive`.`idx_archive_messages_thread` ON `messages`(`threadId`, `messageId`);)",
+
+    // Full-text search indexes (external content: the text is read from messages/threads)
+    R"(CREATE VIRTUAL TABLE IF NOT EXISTS `mboard`.`messages_fts` USING fts5(
+            `content`,
+            content='messages', content_rowid='messageId', tokenize='unicode61 remove_diacritics 2'
+        );)",
+    R"(CREATE VIRTUAL TABLE IF NOT EXISTS `mboard`.`threads_fts` USING fts5(
+            `title`,
+            content='threads', content_rowid='threadId', tokenize='unicode61 remove_diacritics 2'
+        );)",
+
+    // Keep the search indexes in sync (only live messages are indexed)
+    R"(CREATE TRIGGER IF NOT EXISTS `mboard`.`trg_messages_fts_insert` AFTER INSERT ON `messages` WHEN new.`isDeleted`=0 BEGIN
+            INSERT INTO `messages_fts`(rowid, `content`) VALUES (new.`messageId`, new.`content`);
+        END;)",
+    R"(CREATE TRIGGER IF NOT EXISTS `mboard`.`trg_messages_fts_update` AFTER UPDATE OF `content`, `isDeleted` ON `messages` BEGIN
+            INSERT INTO `messages_fts`(`messages_fts`, rowid, `content`) SELECT 'delete', old.`messageId`, old.`content` WHERE old.`isDeleted`=0;
+            INSERT INTO `messages_fts`(rowid, `content`) SELECT new.`messageId`, new.`content` WHERE new.`isDeleted`=0;
+        END;)",
+    R"(CREATE TRIGGER IF NOT EXISTS `mboard`.`trg_messages_fts_delete` AFTER DELETE ON `messages` WHEN old.`isDeleted`=0 BEGIN
+            INSERT INTO `messages_fts`(`messages_fts`, rowid, `content`) VALUES ('delete', old.`messageId`, old.`content`);
+        END;)",
+    R"(CREATE TRIGGER IF NOT EXISTS `mboard`.`trg_threads_fts_insert` AFTER INSERT ON `threads` BEGIN
+            INSERT INTO `threads_fts`(rowid, `title`) VALUES (new.`threadId`, new.`title`);
+        END;)",
+    R"(CREATE TRIGGER IF NOT EXISTS `mboard`.`trg_threads_fts_update` AFTER UPDATE OF `title` ON `threads` BEGIN
+            INSERT INTO `threads_fts`(`threads_fts`, rowid, `title`) VALUES ('delete', old.`threadId`, old.`title`);
+            INSERT INTO `threads_fts`(rowid, `title`) VALUES (new.`threadId`, new.`title`);
+        END;)",
+    R"(CREATE TRIGGER IF NOT EXISTS `mboard`.`trg_threads_fts_delete` AFTER DELETE ON `threads` BEGIN
+            INSERT INTO `threads_fts`(`threads_fts`, rowid, `title`) VALUES ('delete', old.`threadId`, old.`title`);
+        END;)"
     };
 }
@@ -3,7 +3,11 @@
 #include "Mantids30/Protocol_HTTP/api_return.h"
 
 #include "../definitions/context.h"
+#include "pagination.h"
 #include <json/value.h>
+#include <algorithm>
+#include <set>
+#include <vector>
 
 #include <Mantids30/Memory/a_allvars.h>
 
@@ -13,46 +17,127 @@ using namespace Mantids30::Memory;
 using namespace Mantids30::Network::Servers;
 using namespace Mantids30::Network::Protocols;
 
+// Suggested delay between two polls of the message events
+#define MESSAGE_EVENTS_RETRY_MS 2000
+// Terms of a search query (the rest is ignored)
+#define SEARCH_MAX_TERMS 16
+// Threads and messages per thread of a batch fetch
+#define MESSAGES_BATCH_MAX_THREADS 50
+#define MESSAGES_BATCH_DEFAULT_LIMIT 10
+#define MESSAGES_BATCH_MAX_LIMIT 50
+
 // ============================================================================
 // MESSAGEBOARD API FUNCTIONS
 // ============================================================================
 
-API::APIReturn getThreads(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+// Called (from the writer thread) once a change to the thread list is committed.
+// The thread is the changed row as read inside the write (nullptr if it does not exist).
+// Published with the rest of the batch, see threadListCommitted (dbinit.cpp).
+static void threadListChanged(const std::shared_ptr<const ThreadIndex::Thread> &thread)
+{
+    if (thread)
+        g_ctx.threadIndex.update(thread);
+}
+
+// Called (from the writer thread) once a change to the messages of a thread is committed.
+static void threadMessagesChanged(uint32_t threadId, const char *eventType, const Json::Value &message)
+{
+    g_ctx.versions.bumpThread(threadId);
+    g_ctx.messageEvents.publish(threadId, eventType, message);
+}
+
+// Answer to a conditional GET whose "ifNoneMatch" is current. Handlers can't return a 304 without
+// a body (nor set headers), so it is a 200 that only carries the tag (see api.h).
+static API::APIReturn notModified(const std::string &etag)
+{
+    Json::Value jsonResponse;
+    jsonResponse["notModified"] = true;
+    jsonResponse["etag"] = etag;
+    return jsonResponse;
+}
+
+// Response built by the request thread (a sample of them is timed, see Metrics::measureSerialization).
+static API::APIReturn respond(const Json::Value &response)
 {
-    Threads::Sync::Lock_RD lock(g_ctx.dbShrLock);
+    Metrics::measureSerialization(response);
+    return response;
+}
 
+API::APIReturn getThreads(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+{
+    uint32_t limit = clampPageLimit(JSON_ASUINT(*params.inputJSON, "limit", 0));
+    std::string cursorToken = JSON_ASSTRING(*params.inputJSON, "cursor", "");
     std::string user = params.jwtToken->getSubject();
 
-    APP_LOG->log2(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is fetching threads");
+    ThreadsCursor cursor;
+    if (!cursorToken.empty() && !decodeThreadsCursor(cursorToken, cursor))
+    {
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Invalid cursor");
+    }
 
-    Abstract::UINT32 threadId;
-    Abstract::STRING title, creatorUserId, createdAt, lastPostAt;
-    Abstract::BOOL isPinned, isLocked;
+    g_ctx.requestLog.logRead(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is fetching threads");
 
-    SQLConnector::QueryInstance i = g_ctx.dbConnector->qSelect("SELECT `threadId`, `title`, `creatorUserId`, `createdAt`, `lastPostAt`, `isPinned`, `isLocked` "
-                                                               "FROM `mboard`.`threads` WHERE `isLocked`=0 OR `isLocked`=1 ORDER BY `isPinned` DESC, `lastPostAt` DESC;",
-                                                               {}, {&threadId, &title, &creatorUserId, &createdAt, &lastPostAt, &isPinned, &isLocked});
+    // Conditional GET: the client copy is current, don't touch the database.
+    std::string etag = g_ctx.versions.threadListETag(std::to_string(limit) + "|" + cursorToken);
+    if (JSON_ASSTRING(*params.inputJSON, "ifNoneMatch", "") == etag)
+    {
+        return notModified(etag);
+    }
 
-    Json::Value jsonResponse = Json::arrayValue;
-    while (i.getResultsOK() && i.query->step())
+    // Immutable version of the list (taken after the ETag): no database connection, no lock and no
+    // cached response tree to copy, the page is built straight from the shared rows.
+    std::shared_ptr<const ThreadIndex::Snapshot> snapshot = g_ctx.threadIndex.snapshot();
+    size_t position = cursorToken.empty() ? 0 : snapshot->after(cursor.isPinned, cursor.lastPostAt, cursor.threadId);
+    size_t end = std::min(snapshot->size, position + limit);
+
+    Json::Value jsonResponse;
+    jsonResponse["threads"] = Json::arrayValue;
+    jsonResponse["nextCursor"] = Json::nullValue;
+
+    Json::Value &threads = jsonResponse["threads"];
+    for (; position < end; position++)
     {
-        Json::Value x;
-        x["threadId"] = threadId.getValue();
-        x["title"] = title.getValue();
-        x["creatorUserId"] = creatorUserId.getValue();
-        x["createdAt"] = createdAt.getValue();
-        x["lastPostAt"] = lastPostAt.getValue();
-        x["isPinned"] = isPinned.getValue();
-        x["isLocked"] = isLocked.getValue();
-        jsonResponse.append(x);
+        const ThreadIndex::Thread &thread = snapshot->at(position);
+
+        // Each row is built in place inside the response (no intermediate copy).
+        Json::Value &x = threads.append(Json::Value(Json::objectValue));
+        x["threadId"] = thread.threadId;
+        x["title"] = thread.title;
+        x["creatorUserId"] = thread.creatorUserId;
+        x["createdAt"] = thread.createdAt;
+        x["lastPostAt"] = thread.lastPostAt;
+        x["isPinned"] = thread.isPinned;
+        x["isLocked"] = thread.isLocked;
+        x["messageCount"] = thread.messageCount;
+        if (thread.messageCount != 0)
+        {
+            x["lastMessageId"] = thread.lastMessageId;
+            x["lastPosterId"] = thread.lastPosterId;
+        }
+        else
+        {
+            x["lastMessageId"] = Json::nullValue;
+            x["lastPosterId"] = Json::nullValue;
+        }
     }
-    return jsonResponse;
+
+    if (end < snapshot->size)
+    {
+        // There is at least one more thread: hand out the position of the last returned one.
+        const ThreadIndex::Thread &last = snapshot->at(end - 1);
+        ThreadsCursor next;
+        next.isPinned = last.isPinned;
+        next.lastPostAt = last.lastPostAt;
+        next.threadId = last.threadId;
+        jsonResponse["nextCursor"] = encodeThreadsCursor(next);
+    }
+
+    jsonResponse["etag"] = etag;
+    return respond(jsonResponse);
 }
 
 API::APIReturn createThread(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
 {
-    Threads::Sync::Lock_RW lock(g_ctx.dbShrLock);
-
     std::string title = JSON_ASSTRING(*params.inputJSON, "title", "");
     std::string user = params.jwtToken->getSubject();
 
@@ -61,21 +146,34 @@ API::APIReturn createThread(void *, const API::RESTful::RequestParameters &param
         return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Thread title is required");
     }
 
-    APP_LOG->log2(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is creating thread: %s", title.c_str());
-
-    if (!g_ctx.dbConnector->execute("INSERT INTO `mboard`.`threads` (title, creatorUserId) VALUES (:title, :userId);", {{":title", MAKE_VAR(STRING, title)}, {":userId", MAKE_VAR(STRING, user)}}))
-    {
-        return API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
-    }
+    g_ctx.requestLog.log(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is creating thread: %s", title.c_str());
 
-    return API::APIReturn();
+    std::shared_ptr<const ThreadIndex::Thread> thread;
+    return g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &result) -> bool
+        {
+            Abstract::UINT32 threadId;
+            {
+                SQLConnector::QueryInstance i = db->qSelect("INSERT INTO `mboard`.`threads` (title, creatorUserId) VALUES (:title, :userId) RETURNING `threadId`;",
+                                                            {{":title", MAKE_VAR(STRING, title)}, {":userId", MAKE_VAR(STRING, user)}}, {&threadId});
+                if (!i.getResultsOK() || !i.query->step())
+                {
+                    result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+                    return false;
+                }
+            }
+            thread = ThreadIndex::fetch(db, threadId.getValue());
+            return true;
+        },
+        [&] { threadListChanged(thread); });
 }
 
 API::APIReturn getMessages(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
 {
-    Threads::Sync::Lock_RD lock(g_ctx.dbShrLock);
-
     uint32_t threadId = JSON_ASUINT(*params.inputJSON, "threadId", 0);
+    uint32_t afterMessageId = JSON_ASUINT(*params.inputJSON, "afterMessageId", 0);
+    uint32_t beforeMessageId = JSON_ASUINT(*params.inputJSON, "beforeMessageId", 0);
+    uint32_t limit = clampPageLimit(JSON_ASUINT(*params.inputJSON, "limit", 0));
     std::string user = params.jwtToken->getSubject();
 
     if (threadId == 0)
@@ -83,20 +181,60 @@ API::APIReturn getMessages(void *, const API::RESTful::RequestParameters &params
         return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Thread ID is required");
     }
 
-    APP_LOG->log2(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is fetching messages for thread %d", threadId);
+    if (afterMessageId != 0 && beforeMessageId != 0)
+    {
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Use either afterMessageId or beforeMessageId");
+    }
+
+    g_ctx.requestLog.logRead(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is fetching messages for thread %d", threadId);
+
+    // Conditional GET: the client copy is current, don't touch the database.
+    std::string etag = g_ctx.versions.threadETag(threadId, std::to_string(limit) + "|" + std::to_string(afterMessageId) + "|" + std::to_string(beforeMessageId));
+    if (JSON_ASSTRING(*params.inputJSON, "ifNoneMatch", "") == etag)
+    {
+        return notModified(etag);
+    }
+
+    // Taken before the query: polling the events from here can't miss a change made after the page
+    // was read (changes already in the page may be received again).
+    uint64_t lastEventId = g_ctx.messageEvents.lastEventId();
+
+    ConnectionPool::Lease db = g_ctx.dbPool.reader();
 
     Abstract::UINT32 messageId;
     Abstract::STRING userId, content, ipAddress, userAgent, createdAt, editedAt;
     Abstract::BOOL isDeleted;
 
-    SQLConnector::QueryInstance i = g_ctx.dbConnector->qSelect("SELECT `messageId`, `userId`, `content`, `ipAddress`, `userAgent`, `createdAt`, `editedAt`, `isDeleted` "
-                                                               "FROM `mboard`.`messages` WHERE `threadId`=:threadId AND `isDeleted`=0 ORDER BY `createdAt` ASC;",
-                                                               {{":threadId", MAKE_VAR(UINT32, threadId)}}, {&messageId, &userId, &content, &ipAddress, &userAgent, &createdAt, &editedAt, &isDeleted});
-
-    Json::Value jsonResponse = Json::arrayValue;
+    // Both directions are range reads over idx_messages_live, one extra row tells if there are more pages.
+    bool backwards = beforeMessageId != 0;
+    SQLConnector::QueryInstance i = backwards ? db->qSelect("SELECT `messageId`, `userId`, `content`, `ipAddress`, `userAgent`, `createdAt`, `editedAt`, `isDeleted` "
+                                                            "FROM `mboard`.`messages` WHERE `threadId`=:threadId AND `isDeleted`=0 AND `messageId`<:beforeMessageId "
+                                                            "ORDER BY `messageId` DESC LIMIT :limit;",
+                                                            {{":threadId", MAKE_VAR(UINT32, threadId)},
+                                                             {":beforeMessageId", MAKE_VAR(UINT32, beforeMessageId)},
+                                                             {":limit", MAKE_VAR(UINT32, limit + 1)}},
+                                                            {&messageId, &userId, &content, &ipAddress, &userAgent, &createdAt, &editedAt, &isDeleted})
+                                              : db->qSelect("SELECT `messageId`, `userId`, `content`, `ipAddress`, `userAgent`, `createdAt`, `editedAt`, `isDeleted` "
+                                                            "FROM `mboard`.`messages` WHERE `threadId`=:threadId AND `isDeleted`=0 AND `messageId`>:afterMessageId "
+                                                            "ORDER BY `messageId` ASC LIMIT :limit;",
+                                                            {{":threadId", MAKE_VAR(UINT32, threadId)},
+                                                             {":afterMessageId", MAKE_VAR(UINT32, afterMessageId)},
+                                                             {":limit", MAKE_VAR(UINT32, limit + 1)}},
+                                                            {&messageId, &userId, &content, &ipAddress, &userAgent, &createdAt, &editedAt, &isDeleted});
+
+    Json::Value jsonResponse;
+    Json::Value &messages = jsonResponse["messages"] = Json::arrayValue;
+    bool hasMore = false;
     while (i.getResultsOK() && i.query->step())
     {
-        Json::Value x;
+        if (messages.size() == limit)
+        {
+            hasMore = true;
+            break;
+        }
+
+        // Each row is built in place inside the response (no intermediate copy).
+        Json::Value &x = messages.append(Json::Value(Json::objectValue));
         x["messageId"] = messageId.getValue();
         x["userId"] = userId.getValue();
         x["content"] = content.getValue();
@@ -104,17 +242,102 @@ API::APIReturn getMessages(void *, const API::RESTful::RequestParameters &params
         x["userAgent"] = userAgent.getValue();
         x["createdAt"] = createdAt.getValue();
         x["editedAt"] = editedAt.getValue();
-        jsonResponse.append(x);
     }
-    return jsonResponse;
+
+    // Pages are always returned in chronological order (swapping rows moves no data).
+    if (backwards)
+    {
+        for (Json::ArrayIndex a = 0, b = messages.size(); a + 1 < b; a++, b--)
+        {
+            messages[a].swap(messages[b - 1]);
+        }
+    }
+
+    jsonResponse["hasMore"] = hasMore;
+    jsonResponse["etag"] = etag;
+    jsonResponse["lastEventId"] = static_cast<Json::UInt64>(lastEventId);
+    return respond(jsonResponse);
 }
 
-API::APIReturn postMessage(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+API::APIReturn getMessagesBatch(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
 {
-    Threads::Sync::Lock_RW lock(g_ctx.dbShrLock);
+    const Json::Value &threadIdsParam = (*params.inputJSON)["threadIds"];
+    uint32_t limit = JSON_ASUINT(*params.inputJSON, "limit", 0);
+    std::string user = params.jwtToken->getSubject();
+
+    if (limit == 0)
+        limit = MESSAGES_BATCH_DEFAULT_LIMIT;
+    if (limit > MESSAGES_BATCH_MAX_LIMIT)
+        limit = MESSAGES_BATCH_MAX_LIMIT;
+
+    if (!threadIdsParam.isArray() || threadIdsParam.empty())
+    {
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Thread IDs are required");
+    }
+
+    if (threadIdsParam.size() > MESSAGES_BATCH_MAX_THREADS)
+    {
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Too many thread IDs");
+    }
+
+    std::set<uint32_t> threadIds;
+    for (const auto &threadId : threadIdsParam)
+    {
+        if (!threadId.isUInt() || threadId.asUInt() == 0)
+        {
+            return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Invalid thread ID");
+        }
+        threadIds.insert(threadId.asUInt());
+    }
+
+    g_ctx.requestLog.logRead(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is fetching the last messages of %zu threads", threadIds.size());
+
+    // Every requested thread is in the response, even without messages.
+    Json::Value jsonResponse;
+    Json::Value &byThread = jsonResponse["messages"] = Json::objectValue;
+    std::string threadIdsList;
+    for (uint32_t threadId : threadIds)
+    {
+        byThread[std::to_string(threadId)] = Json::arrayValue;
+        threadIdsList += (threadIdsList.empty() ? "[" : ",") + std::to_string(threadId);
+    }
+    threadIdsList += "]";
+
+    ConnectionPool::Lease db = g_ctx.dbPool.reader();
 
+    Abstract::UINT32 threadId, messageId;
+    Abstract::STRING userId, content, ipAddress, userAgent, createdAt, editedAt;
+
+    // One statement for all the threads: every thread is a bounded seek over idx_messages_live
+    // (only its last :limit messages are read, whatever the size of the thread).
+    SQLConnector::QueryInstance i = db->qSelect("SELECT m.`threadId`, m.`messageId`, m.`userId`, m.`content`, m.`ipAddress`, m.`userAgent`, m.`createdAt`, m.`editedAt` "
+                                                "FROM json_each(:threadIds) t JOIN `mboard`.`messages` m ON m.`messageId` IN ("
+                                                "SELECT `messageId` FROM `mboard`.`messages` WHERE `threadId`=t.`value` AND `isDeleted`=0 ORDER BY `messageId` DESC LIMIT :limit) "
+                                                "ORDER BY m.`threadId`, m.`messageId`;",
+                                                {{":threadIds", MAKE_VAR(STRING, threadIdsList)}, {":limit", MAKE_VAR(UINT32, limit)}},
+                                                {&threadId, &messageId, &userId, &content, &ipAddress, &userAgent, &createdAt, &editedAt});
+
+    while (i.getResultsOK() && i.query->step())
+    {
+        Json::Value &x = byThread[std::to_string(threadId.getValue())].append(Json::Value(Json::objectValue));
+        x["messageId"] = messageId.getValue();
+        x["userId"] = userId.getValue();
+        x["content"] = content.getValue();
+        x["ipAddress"] = ipAddress.getValue();
+        x["userAgent"] = userAgent.getValue();
+        x["createdAt"] = createdAt.getValue();
+        x["editedAt"] = editedAt.getValue();
+    }
+
+    return respond(jsonResponse);
+}
+
+API::APIReturn getMessageEvents(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+{
     uint32_t threadId = JSON_ASUINT(*params.inputJSON, "threadId", 0);
-    std::string content = JSON_ASSTRING(*params.inputJSON, "content", "");
+    // Id 0 is a valid starting point (nothing published yet), only a missing id means "from now".
+    bool fromNow = !params.inputJSON->isObject() || !params.inputJSON->isMember("lastEventId");
+    uint64_t lastEventId = JSON_ASUINT64(*params.inputJSON, "lastEventId", 0);
     std::string user = params.jwtToken->getSubject();
 
     if (threadId == 0)
@@ -122,61 +345,145 @@ API::APIReturn postMessage(void *, const API::RESTful::RequestParameters &params
         return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Thread ID is required");
     }
 
-    if (content.empty())
+    g_ctx.requestLog.logRead(__func__, user, clientDetails.ipAddress, Logs::LEVEL_DEBUG, "User is polling message events for thread %d", threadId);
+
+    // Served from memory: no database access and nothing held between calls.
+    Json::Value jsonResponse;
+    jsonResponse["events"] = Json::arrayValue;
+    if (fromNow)
     {
-        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Message content is required");
+        // New subscription without a page of messages: start from now.
+        lastEventId = g_ctx.messageEvents.lastEventId();
+        jsonResponse["resync"] = false;
     }
-
-    APP_LOG->log2(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is posting message to thread %d", threadId);
-
-    // Check if thread exists and is not locked
-    Abstract::BOOL isLocked;
+    else
     {
-        SQLConnector::QueryInstance check = g_ctx.dbConnector->qSelect("SELECT `isLocked` FROM `mboard`.`threads` WHERE `threadId`=:threadId;", {{":threadId", MAKE_VAR(UINT32, threadId)}},
-                                                                       {&isLocked});
+        jsonResponse["resync"] = !g_ctx.messageEvents.eventsAfter(threadId, lastEventId, jsonResponse["events"]);
+    }
+    jsonResponse["lastEventId"] = static_cast<Json::UInt64>(lastEventId);
+    jsonResponse["retryMS"] = MESSAGE_EVENTS_RETRY_MS;
+    return respond(jsonResponse);
+}
 
-        if (!check.getResultsOK() || !check.query->step())
-        {
-            return API::APIReturn(HTTP::Status::S_404_NOT_FOUND, "not_found", "Thread not found");
-        }
-        if (isLocked.getValue())
+// Turns the user query into an FTS5 query: every word is quoted (FTS5 operators and syntax
+// are not available to the client) and all the words must match.
+static std::string toFTSQuery(const std::string &query)
+{
+    std::string ftsQuery;
+    size_t terms = 0, pos = 0;
+    while (terms < SEARCH_MAX_TERMS)
+    {
+        pos = query.find_first_not_of(" \t\r\n", pos);
+        if (pos == std::string::npos)
+            break;
+        size_t end = query.find_first_of(" \t\r\n", pos);
+        if (end == std::string::npos)
+            end = query.size();
+
+        if (!ftsQuery.empty())
+            ftsQuery += ' ';
+        ftsQuery += '"';
+        for (size_t i = pos; i < end; i++)
         {
-            return API::APIReturn(HTTP::Status::S_403_FORBIDDEN, "forbidden", "Thread is locked");
+            if (query[i] == '"')
+                ftsQuery += '"';
+            ftsQuery += query[i];
         }
+        ftsQuery += '"';
+
+        terms++;
+        pos = end;
+    }
+    return ftsQuery;
+}
+
+API::APIReturn searchMessages(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+{
+    std::string ftsQuery = toFTSQuery(JSON_ASSTRING(*params.inputJSON, "q", ""));
+    uint32_t limit = clampPageLimit(JSON_ASUINT(*params.inputJSON, "limit", 0));
+    std::string cursorToken = JSON_ASSTRING(*params.inputJSON, "cursor", "");
+    std::string user = params.jwtToken->getSubject();
+
+    if (ftsQuery.empty())
+    {
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Search query is required");
     }
 
-    // Insert message
-    if (!g_ctx.dbConnector->execute("INSERT INTO `mboard`.`messages` (threadId, userId, content, ipAddress, userAgent) "
-                                    "VALUES (:threadId, :userId, :content, :ipAddress, :userAgent);",
-                                    {{":threadId", MAKE_VAR(UINT32, threadId)},
-                                     {":userId", MAKE_VAR(STRING, user)},
-                                     {":content", MAKE_VAR(STRING, content)},
-                                     {":ipAddress", MAKE_VAR(STRING, clientDetails.ipAddress)},
-                                     {":userAgent", MAKE_VAR(STRING, clientDetails.userAgent)}}))
+    uint32_t offset = 0;
+    if (!cursorToken.empty() && !decodeSearchCursor(cursorToken, offset))
     {
-        return API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Invalid cursor");
     }
 
-    // Update thread's lastPostAt
-    if (!g_ctx.dbConnector->execute("UPDATE `mboard`.`threads` SET `lastPostAt`=CURRENT_TIMESTAMP WHERE `threadId`=:threadId;", {{":threadId", MAKE_VAR(UINT32, threadId)}}))
+    g_ctx.requestLog.logRead(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is searching: %s", ftsQuery.c_str());
+
+    ConnectionPool::Lease db = g_ctx.dbPool.reader();
+
+    Abstract::STRING kind, snippet, createdAt;
+    Abstract::UINT32 id, threadId;
+
+    // 1) Both FTS indexes give their best offset+limit+1 matches by relevance (bm25), which are
+    //    merged into the requested page (one extra row tells if there are more pages). No snippet is
+    //    built at this stage.
+    // 2) Only the rows of the page are looked up again (by rowid) to build their snippets.
+    SQLConnector::QueryInstance i = db->qSelect("WITH `page` AS MATERIALIZED (SELECT `kind`, `id`, `rank` FROM ("
+                                                "SELECT * FROM (SELECT 'message' AS `kind`, rowid AS `id`, rank AS `rank` "
+                                                "FROM `mboard`.`messages_fts` WHERE `messages_fts` MATCH :query ORDER BY rank LIMIT :window) "
+                                                "UNION ALL "
+                                                "SELECT * FROM (SELECT 'thread' AS `kind`, rowid AS `id`, rank AS `rank` "
+                                                "FROM `mboard`.`threads_fts` WHERE `threads_fts` MATCH :query ORDER BY rank LIMIT :window)"
+                                                ") ORDER BY `rank`, `kind`, `id` LIMIT :limit OFFSET :offset) "
+                                                "SELECT `kind`, `id`, `threadId`, `snippet`, `createdAt` FROM ("
+                                                "SELECT p.`kind` AS `kind`, p.`id` AS `id`, m.`threadId` AS `threadId`, snippet(`messages_fts`, 0, '[', ']', '...', 16) AS `snippet`, m.`createdAt` AS `createdAt`, p.`rank` AS `rank` "
+                                                "FROM `page` p CROSS JOIN `mboard`.`messages_fts` JOIN `mboard`.`messages` m ON m.`messageId`=p.`id` "
+                                                "WHERE p.`kind`='message' AND `messages_fts`.rowid=p.`id` AND `messages_fts` MATCH :query "
+                                                "UNION ALL "
+                                                "SELECT p.`kind` AS `kind`, p.`id` AS `id`, t.`threadId` AS `threadId`, snippet(`threads_fts`, 0, '[', ']', '...', 16) AS `snippet`, t.`createdAt` AS `createdAt`, p.`rank` AS `rank` "
+                                                "FROM `page` p CROSS JOIN `mboard`.`threads_fts` JOIN `mboard`.`threads` t ON t.`threadId`=p.`id` "
+                                                "WHERE p.`kind`='thread' AND `threads_fts`.rowid=p.`id` AND `threads_fts` MATCH :query"
+                                                ") ORDER BY `rank`, `kind`, `id`;",
+                                                {{":query", MAKE_VAR(STRING, ftsQuery)},
+                                                 {":window", MAKE_VAR(UINT32, offset + limit + 1)},
+                                                 {":limit", MAKE_VAR(UINT32, limit + 1)},
+                                                 {":offset", MAKE_VAR(UINT32, offset)}},
+                                                {&kind, &id, &threadId, &snippet, &createdAt});
+
+    Json::Value jsonResponse;
+    jsonResponse["results"] = Json::arrayValue;
+    jsonResponse["nextCursor"] = Json::nullValue;
+
+    Json::Value &results = jsonResponse["results"];
+    uint32_t count = 0;
+    while (i.getResultsOK() && i.query->step())
     {
-        return API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed updating thread");
+        if (count == limit)
+        {
+            if (offset + limit <= PAGINATION_MAX_SEARCH_OFFSET)
+                jsonResponse["nextCursor"] = encodeSearchCursor(offset + limit);
+            break;
+        }
+
+        Json::Value &x = results.append(Json::Value(Json::objectValue));
+        x["type"] = kind.getValue();
+        x["id"] = id.getValue();
+        x["threadId"] = threadId.getValue();
+        x["snippet"] = snippet.getValue();
+        x["createdAt"] = createdAt.getValue();
+        count++;
     }
 
-    return API::APIReturn();
+    return respond(jsonResponse);
 }
 
-API::APIReturn editMessage(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+API::APIReturn postMessage(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
 {
-    Threads::Sync::Lock_RW lock(g_ctx.dbShrLock);
-
-    uint32_t messageId = JSON_ASUINT(*params.inputJSON, "messageId", 0);
+    uint32_t threadId = JSON_ASUINT(*params.inputJSON, "threadId", 0);
     std::string content = JSON_ASSTRING(*params.inputJSON, "content", "");
     std::string user = params.jwtToken->getSubject();
 
-    if (messageId == 0)
+    if (threadId == 0)
     {
-        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Message ID is required");
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Thread ID is required");
     }
 
     if (content.empty())
@@ -184,39 +491,148 @@ API::APIReturn editMessage(void *, const API::RESTful::RequestParameters &params
         return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Message content is required");
     }
 
-    APP_LOG->log2(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is editing message %d", messageId);
+    g_ctx.requestLog.log(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is posting message to thread %d", threadId);
 
-    // Check if user owns the message
-    Abstract::STRING messageOwner;
-    {
-        SQLConnector::QueryInstance check = g_ctx.dbConnector->qSelect("SELECT `userId` FROM `mboard`.`messages` WHERE `messageId`=:messageId AND `isDeleted`=0;",
-                                                                       {{":messageId", MAKE_VAR(UINT32, messageId)}}, {&messageOwner});
-
-        if (!check.getResultsOK() || !check.query->step())
+    Json::Value message;
+    std::shared_ptr<const ThreadIndex::Thread> thread;
+    return g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &result) -> bool
         {
-            return API::APIReturn(HTTP::Status::S_404_NOT_FOUND, "not_found", "Message not found");
-        }
-
-        if (messageOwner.getValue() != user)
+            // Insert only if the thread exists and is not locked, in the same statement.
+            Abstract::UINT32 messageId;
+            Abstract::STRING createdAt;
+            bool inserted;
+            {
+                SQLConnector::QueryInstance i = db->qSelect("INSERT INTO `mboard`.`messages` (threadId, userId, content, ipAddress, userAgent) "
+                                                            "SELECT `threadId`, :userId, :content, :ipAddress, :userAgent FROM `mboard`.`threads` "
+                                                            "WHERE `threadId`=:threadId AND `isLocked`=0 "
+                                                            "RETURNING `messageId`, `createdAt`;",
+                                                            {{":threadId", MAKE_VAR(UINT32, threadId)},
+                                                             {":userId", MAKE_VAR(STRING, user)},
+                                                             {":content", MAKE_VAR(STRING, content)},
+                                                             {":ipAddress", MAKE_VAR(STRING, clientDetails.ipAddress)},
+                                                             {":userAgent", MAKE_VAR(STRING, clientDetails.userAgent)}},
+                                                            {&messageId, &createdAt});
+                if (!i.getResultsOK())
+                {
+                    result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+                    return false;
+                }
+                inserted = i.query->step();
+            }
+
+            if (!inserted)
+            {
+                // Nothing was inserted: find out why (only on this error path).
+                Abstract::BOOL isLocked;
+                SQLConnector::QueryInstance check = db->qSelect("SELECT `isLocked` FROM `mboard`.`threads` WHERE `threadId`=:threadId;", {{":threadId", MAKE_VAR(UINT32, threadId)}}, {&isLocked});
+
+                if (!check.getResultsOK() || !check.query->step())
+                {
+                    result = API::APIReturn(HTTP::Status::S_404_NOT_FOUND, "not_found", "Thread not found");
+                }
+                else
+                {
+                    result = API::APIReturn(HTTP::Status::S_403_FORBIDDEN, "forbidden", "Thread is locked");
+                }
+                return false;
+            }
+
+            // Update thread's lastPostAt and counters (committed together with the message)
+            if (!db->execute("UPDATE `mboard`.`threads` SET `lastPostAt`=:createdAt, `messageCount`=`messageCount`+1, `lastMessageId`=:messageId, `lastPosterId`=:userId "
+                             "WHERE `threadId`=:threadId;",
+                             {{":createdAt", MAKE_VAR(STRING, createdAt.getValue())},
+                              {":messageId", MAKE_VAR(UINT32, messageId.getValue())},
+                              {":userId", MAKE_VAR(STRING, user)},
+                              {":threadId", MAKE_VAR(UINT32, threadId)}}))
+            {
+                result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed updating thread");
+                return false;
+            }
+            thread = ThreadIndex::fetch(db, threadId);
+
+            Json::Value jsonResponse;
+            jsonResponse["messageId"] = messageId.getValue();
+            jsonResponse["createdAt"] = createdAt.getValue();
+            result = jsonResponse;
+
+            message = jsonResponse;
+            message["userId"] = user;
+            message["content"] = content;
+            message["ipAddress"] = clientDetails.ipAddress;
+            message["userAgent"] = clientDetails.userAgent;
+            message["editedAt"] = Json::nullValue;
+            return true;
+        },
+        [&]
         {
-            return API::APIReturn(HTTP::Status::S_403_FORBIDDEN, "forbidden", "Not authorized to edit this message");
-        }
+            threadListChanged(thread);
+            threadMessagesChanged(threadId, "created", message);
+        });
+}
+
+API::APIReturn editMessage(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+{
+    uint32_t messageId = JSON_ASUINT(*params.inputJSON, "messageId", 0);
+    std::string content = JSON_ASSTRING(*params.inputJSON, "content", "");
+    std::string user = params.jwtToken->getSubject();
+
+    if (messageId == 0)
+    {
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Message ID is required");
     }
 
-    if (!g_ctx.dbConnector->execute("UPDATE `mboard`.`messages` SET `content`=:content, `editedAt`=CURRENT_TIMESTAMP "
-                                    "WHERE `messageId`=:messageId;",
-                                    {{":content", MAKE_VAR(STRING, content)}, {":messageId", MAKE_VAR(UINT32, messageId)}}))
+    if (content.empty())
     {
-        return API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+        return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Message content is required");
     }
 
-    return API::APIReturn();
+    g_ctx.requestLog.log(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is editing message %d", messageId);
+
+    Abstract::UINT32 messageThreadId;
+    Json::Value message;
+    return g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &result) -> bool
+        {
+            // Check if user owns the message
+            Abstract::STRING messageOwner;
+            {
+                SQLConnector::QueryInstance check = db->qSelect("SELECT `userId`, `threadId` FROM `mboard`.`messages` WHERE `messageId`=:messageId AND `isDeleted`=0;",
+                                                                {{":messageId", MAKE_VAR(UINT32, messageId)}}, {&messageOwner, &messageThreadId});
+
+                if (!check.getResultsOK() || !check.query->step())
+                {
+                    result = API::APIReturn(HTTP::Status::S_404_NOT_FOUND, "not_found", "Message not found");
+                    return false;
+                }
+
+                if (messageOwner.getValue() != user)
+                {
+                    result = API::APIReturn(HTTP::Status::S_403_FORBIDDEN, "forbidden", "Not authorized to edit this message");
+                    return false;
+                }
+            }
+
+            Abstract::STRING editedAt;
+            SQLConnector::QueryInstance i = db->qSelect("UPDATE `mboard`.`messages` SET `content`=:content, `editedAt`=CURRENT_TIMESTAMP "
+                                                        "WHERE `messageId`=:messageId RETURNING `editedAt`;",
+                                                        {{":content", MAKE_VAR(STRING, content)}, {":messageId", MAKE_VAR(UINT32, messageId)}}, {&editedAt});
+            if (!i.getResultsOK() || !i.query->step())
+            {
+                result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+                return false;
+            }
+
+            message["messageId"] = messageId;
+            message["content"] = content;
+            message["editedAt"] = editedAt.getValue();
+            return true;
+        },
+        [&] { threadMessagesChanged(messageThreadId.getValue(), "edited", message); });
 }
 
 API::APIReturn deleteMessage(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
 {
-    Threads::Sync::Lock_RW lock(g_ctx.dbShrLock);
-
     uint32_t messageId = JSON_ASUINT(*params.inputJSON, "messageId", 0);
     std::string user = params.jwtToken->getSubject();
 
@@ -225,37 +641,65 @@ API::APIReturn deleteMessage(void *, const API::RESTful::RequestParameters &para
         return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Message ID is required");
     }
 
-    APP_LOG->log2(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is deleting message %d", messageId);
+    g_ctx.requestLog.log(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is deleting message %d", messageId);
 
-    // Check if user owns the message
-    Abstract::STRING messageOwner;
-    {
-        SQLConnector::QueryInstance check = g_ctx.dbConnector->qSelect("SELECT `userId` FROM `mboard`.`messages` WHERE `messageId`=:messageId AND `isDeleted`=0;",
-                                                                       {{":messageId", MAKE_VAR(UINT32, messageId)}}, {&messageOwner});
+    bool isAdmin = params.jwtToken->isAdmin();
 
-        if (!check.getResultsOK() || !check.query->step())
+    Abstract::UINT32 messageThreadId;
+    std::shared_ptr<const ThreadIndex::Thread> thread;
+    return g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &result) -> bool
         {
-            return API::APIReturn(HTTP::Status::S_404_NOT_FOUND, "not_found", "Message not found");
-        }
-
-        if (messageOwner.getValue() != user && !params.jwtToken->isAdmin())
+            // Check if user owns the message
+            Abstract::STRING messageOwner;
+            {
+                SQLConnector::QueryInstance check = db->qSelect("SELECT `userId`, `threadId` FROM `mboard`.`messages` WHERE `messageId`=:messageId AND `isDeleted`=0;",
+                                                                {{":messageId", MAKE_VAR(UINT32, messageId)}}, {&messageOwner, &messageThreadId});
+
+                if (!check.getResultsOK() || !check.query->step())
+                {
+                    result = API::APIReturn(HTTP::Status::S_404_NOT_FOUND, "not_found", "Message not found");
+                    return false;
+                }
+
+                if (messageOwner.getValue() != user && !isAdmin)
+                {
+                    result = API::APIReturn(HTTP::Status::S_403_FORBIDDEN, "forbidden", "Not authorized to delete this message");
+                    return false;
+                }
+            }
+
+            if (!db->execute("UPDATE `mboard`.`messages` SET `isDeleted`=1, `deletedAt`=CURRENT_TIMESTAMP WHERE `messageId`=:messageId;", {{":messageId", MAKE_VAR(UINT32, messageId)}}))
+            {
+                result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+                return false;
+            }
+
+            // The last live message of the thread may have changed (a single seek over idx_messages_live)
+            if (!db->execute("UPDATE `mboard`.`threads` SET `messageCount`=`messageCount`-1, "
+                             "(`lastMessageId`, `lastPosterId`)=(SELECT `messageId`, `userId` FROM `mboard`.`messages` "
+                             "WHERE `threadId`=:threadId AND `isDeleted`=0 ORDER BY `messageId` DESC LIMIT 1) "
+                             "WHERE `threadId`=:threadId;",
+                             {{":threadId", MAKE_VAR(UINT32, messageThreadId.getValue())}}))
+            {
+                result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed updating thread");
+                return false;
+            }
+            thread = ThreadIndex::fetch(db, messageThreadId.getValue());
+
+            return true;
+        },
+        [&]
         {
-            return API::APIReturn(HTTP::Status::S_403_FORBIDDEN, "forbidden", "Not authorized to delete this message");
-        }
-    }
-
-    if (!g_ctx.dbConnector->execute("UPDATE `mboard`.`messages` SET `isDeleted`=1 WHERE `messageId`=:messageId;", {{":messageId", MAKE_VAR(UINT32, messageId)}}))
-    {
-        return API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
-    }
-
-    return API::APIReturn();
+            threadListChanged(thread);
+            Json::Value message;
+            message["messageId"] = messageId;
+            threadMessagesChanged(messageThreadId.getValue(), "deleted", message);
+        });
 }
 
 API::APIReturn toggleThreadLock(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
 {
-    Threads::Sync::Lock_RW lock(g_ctx.dbShrLock);
-
     uint32_t threadId = JSON_ASUINT(*params.inputJSON, "threadId", 0);
     bool lockStatus = JSON_ASBOOL(*params.inputJSON, "isLocked", false);
     std::string user = params.jwtToken->getSubject();
@@ -265,21 +709,26 @@ API::APIReturn toggleThreadLock(void *, const API::RESTful::RequestParameters &p
         return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Thread ID is required");
     }
 
-    APP_LOG->log2(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is toggling lock for thread %d", threadId);
+    g_ctx.requestLog.log(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is toggling lock for thread %d", threadId);
 
-    if (!g_ctx.dbConnector->execute("UPDATE `mboard`.`threads` SET `isLocked`=:isLocked WHERE `threadId`=:threadId;",
-                                    {{":isLocked", MAKE_VAR(BOOL, lockStatus)}, {":threadId", MAKE_VAR(UINT32, threadId)}}))
-    {
-        return API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
-    }
-
-    return API::APIReturn();
+    std::shared_ptr<const ThreadIndex::Thread> thread;
+    return g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &result) -> bool
+        {
+            if (!db->execute("UPDATE `mboard`.`threads` SET `isLocked`=:isLocked WHERE `threadId`=:threadId;",
+                             {{":isLocked", MAKE_VAR(BOOL, lockStatus)}, {":threadId", MAKE_VAR(UINT32, threadId)}}))
+            {
+                result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+                return false;
+            }
+            thread = ThreadIndex::fetch(db, threadId);
+            return true;
+        },
+        [&] { threadListChanged(thread); });
 }
 
 API::APIReturn toggleThreadPin(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
 {
-    Threads::Sync::Lock_RW lock(g_ctx.dbShrLock);
-
     uint32_t threadId = JSON_ASUINT(*params.inputJSON, "threadId", 0);
     bool pinStatus = JSON_ASBOOL(*params.inputJSON, "isPinned", false);
     std::string user = params.jwtToken->getSubject();
@@ -289,21 +738,39 @@ API::APIReturn toggleThreadPin(void *, const API::RESTful::RequestParameters &pa
         return API::APIReturn(HTTP::Status::S_400_BAD_REQUEST, "invalid_request", "Thread ID is required");
     }
 
-    APP_LOG->log2(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is toggling pin for thread %d", threadId);
+    g_ctx.requestLog.log(__func__, user, clientDetails.ipAddress, Logs::LEVEL_INFO, "User is toggling pin for thread %d", threadId);
 
-    if (!g_ctx.dbConnector->execute("UPDATE `mboard`.`threads` SET `isPinned`=:isPinned WHERE `threadId`=:threadId;",
-                                    {{":isPinned", MAKE_VAR(BOOL, pinStatus)}, {":threadId", MAKE_VAR(UINT32, threadId)}}))
-    {
-        return API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
-    }
-
-    return API::APIReturn();
+    std::shared_ptr<const ThreadIndex::Thread> thread;
+    return g_ctx.dbWriteQueue.submit(
+        [&](SQLConnector_SQLite3 *db, API::APIReturn &result) -> bool
+        {
+            if (!db->execute("UPDATE `mboard`.`threads` SET `isPinned`=:isPinned WHERE `threadId`=:threadId;",
+                             {{":isPinned", MAKE_VAR(BOOL, pinStatus)}, {":threadId", MAKE_VAR(UINT32, threadId)}}))
+            {
+                result = API::APIReturn(HTTP::Status::S_500_INTERNAL_SERVER_ERROR, "internal_error", "DB Failed");
+                return false;
+            }
+            thread = ThreadIndex::fetch(db, threadId);
+            return true;
+        },
+        [&] { threadListChanged(thread); });
 }
 
 // ============================================================================
 // API ENDPOINTS REGISTRATION:
 // ============================================================================
 
+API::APIReturn getMetrics(void *, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+{
+    g_ctx.requestLog.log(__func__, params.jwtToken->getSubject(), clientDetails.ipAddress, Logs::LEVEL_DEBUG, "User is reading the server metrics");
+
+    // The API only returns JSON: the Prometheus text goes in a field (not scrapable, see Metrics).
+    Json::Value jsonResponse;
+    jsonResponse["contentType"] = "text/plain; version=0.0.4";
+    jsonResponse["metrics"] = g_ctx.metrics.prometheusText();
+    return respond(jsonResponse);
+}
+
 auto registerAPIEndpoints() -> std::shared_ptr<API::RESTful::Endpoints>
 {
     auto endpoints = std::make_shared<API::RESTful::Endpoints>();
@@ -311,15 +778,39 @@ auto registerAPIEndpoints() -> std::shared_ptr<API::RESTful::Endpoints>
     using M = API::RESTful::Endpoints;
     using Sec = M::SecurityOptions;
 
+    // Every endpoint is called through the metrics registry, which times the rate limiter and then the real handler.
+    auto addEndpoint = [&endpoints](M::MethodMode method, const std::string &path, const std::set<std::string> &scopes, API::RESTful::MethodType handler)
+    {
+        const char *methodName = method == M::GET ? "GET" : method == M::POST ? "POST" : method == M::PUT ? "PUT" : "DELETE";
+        void *limited = g_ctx.rateLimiter.protect(methodName, path, scopes, handler);
+        endpoints->addEndpoint(method, path, Sec::REQUIRE_JWT_COOKIE_AUTH, scopes, g_ctx.metrics.instrument(methodName, path, &RateLimiter::handle, limited), &Metrics::handle);
+    };
+
     // Messageboard endpoints
-    endpoints->addEndpoint(M::GET, "threads", Sec::REQUIRE_JWT_COOKIE_AUTH, {"READER"}, nullptr, &getThreads);
-    endpoints->addEndpoint(M::POST, "threads", Sec::REQUIRE_JWT_COOKIE_AUTH, {"WRITER"}, nullptr, &createThread);
-    endpoints->addEndpoint(M::GET, "messages", Sec::REQUIRE_JWT_COOKIE_AUTH, {"READER"}, nullptr, &getMessages);
-    endpoints->addEndpoint(M::POST, "messages", Sec::REQUIRE_JWT_COOKIE_AUTH, {"WRITER"}, nullptr, &postMessage);
-    endpoints->addEndpoint(M::PUT, "messages", Sec::REQUIRE_JWT_COOKIE_AUTH, {"WRITER"}, nullptr, &editMessage);
-    endpoints->addEndpoint(M::DELETE, "messages", Sec::REQUIRE_JWT_COOKIE_AUTH, {"WRITER"}, nullptr, &deleteMessage);
-    endpoints->addEndpoint(M::PUT, "threads/lock", Sec::REQUIRE_JWT_COOKIE_AUTH, {"EDITOR"}, nullptr, &toggleThreadLock);
-    endpoints->addEndpoint(M::PUT, "threads/pin", Sec::REQUIRE_JWT_COOKIE_AUTH, {"EDITOR"}, nullptr, &toggleThreadPin);
+    addEndpoint(M::GET, "threads", {"READER"}, &getThreads);
+    addEndpoint(M::POST, "threads", {"WRITER"}, &createThread);
+    addEndpoint(M::GET, "messages", {"READER"}, &getMessages);
+    addEndpoint(M::GET, "messages/batch", {"READER"}, &getMessagesBatch);
+    addEndpoint(M::GET, "messages/events", {"READER"}, &getMessageEvents);
+    addEndpoint(M::GET, "search", {"READER"}, &searchMessages);
+    addEndpoint(M::POST, "messages", {"WRITER"}, &postMessage);
+    addEndpoint(M::PUT, "messages", {"WRITER"}, &editMessage);
+    addEndpoint(M::DELETE, "messages", {"WRITER"}, &deleteMessage);
+    addEndpoint(M::PUT, "threads/lock", {"EDITOR"}, &toggleThreadLock);
+    addEndpoint(M::PUT, "threads/pin", {"EDITOR"}, &toggleThreadPin);
+
+    // Server endpoints
+    addEndpoint(M::GET, "metrics", {"METRICS"}, &getMetrics);
+
+    g_ctx.metrics.addCounter("mboard_rate_limiter_evicted_total", "Rate limit buckets dropped before being idle because the table was full", [] { return g_ctx.rateLimiter.evictedBuckets(); });
+    g_ctx.metrics.addCounter("mboard_request_log_dropped_total", "Read request log lines dropped because the buffer of the thread was full", [] { return g_ctx.requestLog.droppedLines(); });
+    g_ctx.metrics.addCounter("mboard_request_log_sampled_total", "Read request INFO log lines not written because of the sample rate", [] { return g_ctx.requestLog.sampledLines(); });
+
+    // Database executors: the reader pool (one connection per core by default) and the single writer
+    g_ctx.metrics.addGauge("mboard_db_readers", "Reader connections in the pool", [] { return g_ctx.dbPool.readersCount(); });
+    g_ctx.metrics.addGauge("mboard_db_readers_busy", "Reader connections checked out by requests", [] { return g_ctx.dbPool.busyReaders(); });
+    g_ctx.metrics.addGauge("mboard_db_readers_waiting", "Requests waiting for a reader connection", [] { return g_ctx.dbPool.waitingReaders(); });
+    g_ctx.metrics.addGauge("mboard_db_write_queue_depth", "Writes submitted and not committed yet", [] { return g_ctx.dbWriteQueue.depth(); });
 
     return endpoints;
 }
@@ -7,6 +7,22 @@
  */
 auto registerAPIEndpoints() -> std::shared_ptr<Mantids30::API::RESTful::Endpoints>;
 
+/**
+ * @brief Endpoint handlers (registered by registerAPIEndpoints, also called directly by the micro-benchmarks)
+ */
+Mantids30::API::APIReturn getThreads(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn createThread(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn getMessages(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn getMessagesBatch(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn getMessageEvents(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn searchMessages(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn postMessage(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn editMessage(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn deleteMessage(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn toggleThreadLock(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn toggleThreadPin(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+Mantids30::API::APIReturn getMetrics(void *, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+
 
 /*
 API Documentation for Message Board System
@@ -19,26 +35,50 @@ All endpoints require JWT authentication via cookie. Required scopes:
 - READER: Read access to threads and messages
 - WRITER: Write access to create/edit/delete messages
 - EDITOR: Administrative access to lock/pin threads
+- METRICS: Read access to the server metrics
+
+Conditional GET (threads and messages)
+
+The RESTful handlers only see the JSON parameters and return a JSON body: they can't read the
+If-None-Match header, set the ETag header or return a 304 without a body. So the tag travels in the
+"etag" field and the "ifNoneMatch" parameter, and a current tag is answered (without reading the
+database) with a 200 that carries nothing else:
+{
+  "notModified": true,
+  "etag": "\"...\""
+}
 
 Endpoints
 
 1. Get Threads List
 GET /api/v1/threads
 
-Description: Retrieve all active threads ordered by pinned status and last post time.
+Description: Retrieve one page of threads ordered by pinned status and last post time.
+
+Query Parameters:
+- limit (optional): Page size (default 50, max 200)
+- cursor (optional): Opaque token taken from "nextCursor" of the previous page
+- ifNoneMatch (optional): "etag" of a previous response, answered with "notModified" if this page (same limit and cursor) did not change
 
 Response:
-[
-  {
-    "threadId": 1,
-    "title": "Welcome to the forum",
-    "creatorUserId": "user123",
-    "createdAt": "2023-01-15T10:30:00Z",
-    "lastPostAt": "2023-01-20T14:45:00Z",
-    "isPinned": true,
-    "isLocked": false
-  }
-]
+{
+  "threads": [
+    {
+      "threadId": 1,
+      "title": "Welcome to the forum",
+      "creatorUserId": "user123",
+      "createdAt": "2023-01-15T10:30:00Z",
+      "lastPostAt": "2023-01-20T14:45:00Z",
+      "isPinned": true,
+      "isLocked": false,
+      "messageCount": 12,      (messages not deleted)
+      "lastMessageId": 345,    (null when the thread has no messages)
+      "lastPosterId": "user456" (null when the thread has no messages)
+    }
+  ],
+  "nextCursor": "...",     (null when there are no more pages)
+  "etag": "\"...\""         (version of the thread list, for this page)
+}
 
 2. Create New Thread
 POST /api/v1/threads
@@ -55,19 +95,28 @@ GET /api/v1/messages
 
 Query Parameters:
 - threadId (required): Thread identifier
+- afterMessageId (optional): Return messages newer than this one (default: from the beginning)
+- beforeMessageId (optional): Return messages older than this one (can't be combined with afterMessageId)
+- limit (optional): Page size (default 50, max 200)
+- ifNoneMatch (optional): "etag" of a previous response, answered with "notModified" if this page (same limit, afterMessageId and beforeMessageId) did not change
 
-Response:
-[
-  {
-    "messageId": 1,
-    "userId": "user456",
-    "content": "This is the first message",
-    "ipAddress": "192.168.1.100",
-    "userAgent": "Mozilla/5.0...",
-    "createdAt": "2023-01-15T10:35:00Z",
-    "editedAt": null
-  }
-]
+Response (messages in chronological order):
+{
+  "messages": [
+    {
+      "messageId": 1,
+      "userId": "user456",
+      "content": "This is the first message",
+      "ipAddress": "192.168.1.100",
+      "userAgent": "Mozilla/5.0...",
+      "createdAt": "2023-01-15T10:35:00Z",
+      "editedAt": null
+    }
+  ],
+  "hasMore": false,        (more messages exist in the requested direction)
+  "etag": "\"...\"",        (version of the thread messages, for this page)
+  "lastEventId": 118       (poll GET /api/v1/messages/events from here to follow the changes)
+}
 
 4. Post New Message
 POST /api/v1/messages
@@ -78,7 +127,11 @@ Request Body (JSON):
   "content": "This is my new message"
 }
 
-Response: Code 200
+Response:
+{
+  "messageId": 42,
+  "createdAt": "2023-01-20T14:45:00Z"
+}
 
 5. Edit Message
 PUT /api/v1/messages
@@ -123,6 +176,120 @@ Request Body (JSON):
 
 Response: Code 200
 
+9. Message Events
+GET /api/v1/messages/events
+
+Description: Changes (created/edited/deleted messages) of a thread after a given event (delta
+polling), served from memory without touching the database. Start from the lastEventId returned
+by GET /api/v1/messages, then keep calling it with the returned lastEventId (waiting retryMS
+between calls). Changes already in the loaded page may be received again. No server resources
+are held between calls, so idle subscribers cost nothing.
+
+Query Parameters:
+- threadId (required): Thread identifier
+- lastEventId (optional): Last event id received, or the one of GET /api/v1/messages (omit to start from now)
+
+Response:
+{
+  "events": [
+    {
+      "eventId": 120,
+      "type": "created",              ("created", "edited" or "deleted")
+      "message": { "messageId": 42, "userId": "user456", "content": "...", "createdAt": "...", ... }
+    }
+  ],
+  "lastEventId": 120,
+  "resync": false,                    (true: events were lost, reload the messages)
+  "retryMS": 2000
+}
+
+10. Search
+GET /api/v1/search
+
+Description: Full-text search over the message contents and the thread titles, ordered by
+relevance. Deleted messages are not indexed. Every word of the query must match (words are
+matched literally, no search operators).
+
+Query Parameters:
+- q (required): Words to search
+- limit (optional): Results per page (default 50, max 200)
+- cursor (optional): nextCursor of the previous page
+
+Response:
+{
+  "results": [
+    {
+      "type": "message",              ("message" or "thread")
+      "id": 42,                       (messageId, or threadId for threads)
+      "threadId": 1,
+      "snippet": "...the [matching] words...",   (matches are enclosed in brackets)
+      "createdAt": "2024-01-15T14:20:00Z"
+    }
+  ],
+  "nextCursor": "732c3530"            (null on the last page)
+}
+
+11. Get Last Messages of Several Threads
+GET /api/v1/messages/batch
+
+Description: Latest messages of many threads in one request (e.g. thread previews), read with a
+single query.
+
+Query Parameters:
+{
+  "threadIds": [1, 2, 7],  (required, up to 50 threads)
+  "limit": 5               (optional, messages per thread: default 10, max 50)
+}
+
+Response:
+{
+  "messages": {
+    "1": [
+      {
+        "messageId": 42,
+        "userId": "user456",
+        "content": "...",
+        "ipAddress": "192.168.1.100",
+        "userAgent": "Mozilla/5.0...",
+        "createdAt": "2023-01-20T14:45:00Z",
+        "editedAt": null
+      }
+    ],
+    "2": [],               (every requested thread is present, oldest message first)
+    "7": []
+  }
+}
+
+12. Server Metrics
+GET /api/v1/metrics
+
+Description: Latency histograms and response counters of every endpoint, in the Prometheus text
+exposition format. Requires the METRICS scope.
+
+Not scrape-compatible: the text is wrapped in JSON and the endpoint requires the JWT cookie, so
+Prometheus can't read it. For scraping, set Metrics.TextFile (webserver.conf): the same text is
+written to that file for the textfile collector of node_exporter.
+
+Metrics (labels: method, path):
+- mboard_request_duration_seconds: time spent in the handler (histogram, with _quantile gauges for p50/p99/p999)
+- mboard_request_db_wait_seconds: time waiting for a reader connection or in the write queue
+- mboard_request_sql_seconds: time running SQL and reading its rows (until commit for writes)
+- mboard_response_serialization_seconds: time serializing the JSON response (one of every 16 read
+  responses is serialized once more to time it, write responses are not timed)
+- mboard_responses_total: responses by HTTP status (extra label: status)
+
+Server metrics (no labels):
+- mboard_request_log_dropped_total, mboard_request_log_sampled_total: request log lines not written
+- mboard_rate_limiter_evicted_total: rate limit buckets dropped early because the table was full
+- mboard_db_readers, mboard_db_readers_busy, mboard_db_readers_waiting: reader connection pool usage
+- mboard_db_write_queue_depth: writes submitted and not committed yet
+
+Response:
+{
+  "contentType": "text/plain; version=0.0.4",
+  "metrics": "# HELP mboard_request_duration_seconds ..."
+}
+
 Error Responses
 
 All endpoints return standard HTTP status codes:
@@ -131,6 +298,8 @@ All endpoints return standard HTTP status codes:
 - 401: Unauthorized (missing or invalid authentication)
 - 403: Forbidden (insufficient permissions)
 - 404: Not Found (resource not found)
+- 429: Too Many Requests (rate limit exceeded). Handlers can't set response headers, so there is no
+  Retry-After header: the message carries its value, "Too many requests, retry in 1500ms (Retry-After: 2)"
 - 500: Internal Server Error
 
 Security Notes
@@ -141,5 +310,7 @@ Security Notes
 
 Rate Limiting
 Requests are rate-limited based on IP address and user account to prevent abuse. Excessive requests will result in 429 Too Many Requests responses.
+Limits are token buckets configured in webserver.conf (RateLimits): a default limit for all the requests of a client, plus
+per scope limits (e.g. WRITER endpoints) or per endpoint limits (e.g. "GET search").
 
 */
@@ -0,0 +1,108 @@
+#include "pagination.h"
+
+#include <cstdlib>
+
+uint32_t clampPageLimit(const uint32_t &limit)
+{
+    if (limit == 0)
+        return PAGINATION_DEFAULT_LIMIT;
+    if (limit > PAGINATION_MAX_LIMIT)
+        return PAGINATION_MAX_LIMIT;
+    return limit;
+}
+
+std::string toOpaqueToken(const std::string &raw)
+{
+    static const char hexChars[] = "0123456789abcdef";
+    std::string token;
+    token.reserve(raw.size() * 2);
+    for (unsigned char c : raw)
+    {
+        token.push_back(hexChars[c >> 4]);
+        token.push_back(hexChars[c & 0x0F]);
+    }
+    return token;
+}
+
+bool fromOpaqueToken(const std::string &token, std::string &raw)
+{
+    auto nibble = [](char c) -> int
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    };
+
+    if (token.size() % 2 != 0)
+        return false;
+
+    raw.clear();
+    raw.reserve(token.size() / 2);
+    for (size_t i = 0; i < token.size(); i += 2)
+    {
+        int hi = nibble(token[i]), lo = nibble(token[i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        raw.push_back(static_cast<char>((hi << 4) | lo));
+    }
+    return true;
+}
+
+std::string encodeThreadsCursor(const ThreadsCursor &cursor)
+{
+    return toOpaqueToken(std::string(cursor.isPinned ? "1" : "0") + "|" + cursor.lastPostAt + "|" + std::to_string(cursor.threadId));
+}
+
+bool decodeThreadsCursor(const std::string &token, ThreadsCursor &cursor)
+{
+    std::string raw;
+    if (!fromOpaqueToken(token, raw))
+        return false;
+
+    // Format: <isPinned>|<lastPostAt>|<threadId>
+    size_t first = raw.find('|');
+    size_t last = raw.rfind('|');
+    if (first != 1 || last == first || last + 1 >= raw.size())
+        return false;
+
+    if (raw[0] != '0' && raw[0] != '1')
+        return false;
+
+    char *end = nullptr;
+    unsigned long threadId = strtoul(raw.c_str() + last + 1, &end, 10);
+    if (*end != 0 || threadId == 0 || threadId > UINT32_MAX)
+        return false;
+
+    cursor.isPinned = raw[0] == '1';
+    cursor.lastPostAt = raw.substr(first + 1, last - first - 1);
+    cursor.threadId = static_cast<uint32_t>(threadId);
+    return true;
+}
+
+std::string encodeSearchCursor(const uint32_t &offset)
+{
+    return toOpaqueToken("s|" + std::to_string(offset));
+}
+
+bool decodeSearchCursor(const std::string &token, uint32_t &offset)
+{
+    std::string raw;
+    if (!fromOpaqueToken(token, raw))
+        return false;
+
+    // Format: s|<offset>
+    if (raw.size() < 3 || raw.compare(0, 2, "s|") != 0)
+        return false;
+
+    char *end = nullptr;
+    unsigned long value = strtoul(raw.c_str() + 2, &end, 10);
+    if (*end != 0 || value > PAGINATION_MAX_SEARCH_OFFSET)
+        return false;
+
+    offset = static_cast<uint32_t>(value);
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#define PAGINATION_DEFAULT_LIMIT 50
+#define PAGINATION_MAX_LIMIT 200
+// Search results are ranked (not keyset ordered), so the page offset is bounded.
+#define PAGINATION_MAX_SEARCH_OFFSET 1000
+
+/**
+ * @brief Position of the last thread returned by GET /api/v1/threads
+ *
+ * Follows the listing order: isPinned DESC, lastPostAt DESC, threadId DESC.
+ */
+struct ThreadsCursor
+{
+    bool isPinned = false;
+    std::string lastPostAt;
+    uint32_t threadId = 0;
+};
+
+/**
+ * @brief Clamp a client provided page size into [1, PAGINATION_MAX_LIMIT] (0 means default)
+ */
+uint32_t clampPageLimit(const uint32_t &limit);
+
+/**
+ * @brief Encode the cursor as an opaque (hex) token for the client
+ */
+std::string encodeThreadsCursor(const ThreadsCursor &cursor);
+
+/**
+ * @brief Decode an opaque cursor token
+ * @return false if the token is malformed
+ */
+bool decodeThreadsCursor(const std::string &token, ThreadsCursor &cursor);
+
+/**
+ * @brief Encode/decode the position of the next page of search results
+ */
+std::string encodeSearchCursor(const uint32_t &offset);
+bool decodeSearchCursor(const std::string &token, uint32_t &offset);
+
+/**
+ * @brief Hex encoding/decoding used for the opaque cursors
+ */
+std::string toOpaqueToken(const std::string &raw);
+bool fromOpaqueToken(const std::string &token, std::string &raw);
@@ -0,0 +1,78 @@
+#include "messageevents.h"
+
+#include <algorithm>
+
+MessageEvents::MessageEvents(size_t eventsPerThread, size_t maxThreads)
+    : m_eventsPerThread(eventsPerThread)
+    , m_maxThreads(maxThreads)
+{}
+
+void MessageEvents::publish(uint32_t threadId, const char *type, const Json::Value &message)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_threads.find(threadId);
+    if (it == m_threads.end())
+    {
+        if (m_threads.size() >= m_maxThreads)
+        {
+            // Drop the thread with the oldest activity.
+            auto oldest = std::min_element(m_threads.begin(), m_threads.end(),
+                                           [](const auto &a, const auto &b) { return a.second.events.back().eventId < b.second.events.back().eventId; });
+            m_evictedUntil = std::max(m_evictedUntil, oldest->second.events.back().eventId);
+            m_threads.erase(oldest);
+        }
+
+        it = m_threads.emplace(threadId, ThreadLog()).first;
+        // Older events of this thread may have been evicted with a previous log.
+        it->second.droppedUntil = m_evictedUntil;
+    }
+
+    auto data = std::make_shared<Json::Value>();
+    (*data)["eventId"] = static_cast<Json::UInt64>(++m_lastEventId);
+    (*data)["type"] = type;
+    (*data)["message"] = message;
+
+    ThreadLog &log = it->second;
+    log.events.push_back({m_lastEventId, data});
+    if (log.events.size() > m_eventsPerThread)
+    {
+        log.droppedUntil = log.events.front().eventId;
+        log.events.pop_front();
+    }
+}
+
+bool MessageEvents::eventsAfter(uint32_t threadId, uint64_t &lastEventId, Json::Value &events)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_threads.find(threadId);
+    if (it == m_threads.end())
+    {
+        bool complete = lastEventId >= m_evictedUntil;
+        lastEventId = m_lastEventId;
+        return complete;
+    }
+
+    const ThreadLog &log = it->second;
+    if (lastEventId < log.droppedUntil)
+    {
+        lastEventId = m_lastEventId;
+        return false;
+    }
+
+    auto first = std::upper_bound(log.events.begin(), log.events.end(), lastEventId, [](uint64_t id, const Event &event) { return id < event.eventId; });
+    for (auto i = first; i != log.events.end(); ++i)
+    {
+        events.append(*i->data);
+    }
+
+    lastEventId = m_lastEventId;
+    return true;
+}
+
+uint64_t MessageEvents::lastEventId()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastEventId;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <json/value.h>
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief In-process publish/subscribe of message changes (created/edited/deleted), per thread
+ *
+ * Every thread keeps a bounded log of its most recent events identified by a global, increasing
+ * event id. Subscribers don't hold any resource: they ask for the events after the last id they
+ * have seen, which is served from memory without touching the database.
+ */
+class MessageEvents
+{
+public:
+    /**
+     * @param eventsPerThread events kept for every thread
+     * @param maxThreads threads tracked before the least recently active one is dropped
+     */
+    MessageEvents(size_t eventsPerThread, size_t maxThreads);
+
+    /**
+     * @brief Publish an event for the thread
+     * @param type "created", "edited" or "deleted"
+     * @param message message fields
+     */
+    void publish(uint32_t threadId, const char *type, const Json::Value &message);
+
+    /**
+     * @brief Collect the events of a thread after a given event id
+     * @param events output array (appended)
+     * @param lastEventId updated with the id to use on the next call
+     * @return false if events after lastEventId were already dropped (the client must resync)
+     */
+    bool eventsAfter(uint32_t threadId, uint64_t &lastEventId, Json::Value &events);
+
+    /**
+     * @brief Last event id published (subscription starting point)
+     */
+    uint64_t lastEventId();
+
+private:
+    struct Event
+    {
+        uint64_t eventId;
+        std::shared_ptr<const Json::Value> data;
+    };
+
+    struct ThreadLog
+    {
+        std::deque<Event> events;
+        // Last event id dropped from this log (events after it are complete).
+        uint64_t droppedUntil = 0;
+    };
+
+    size_t m_eventsPerThread;
+    size_t m_maxThreads;
+
+    std::mutex m_mutex;
+    uint64_t m_lastEventId = 0;
+    // Events evicted together with whole thread logs are covered by this id.
+    uint64_t m_evictedUntil = 0;
+    std::map<uint32_t, ThreadLog> m_threads;
+};
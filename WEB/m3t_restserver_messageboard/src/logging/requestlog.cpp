@@ -0,0 +1,287 @@
+#include "requestlog.h"
+
+#include "../definitions/context.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// Time between two reports of the dropped/sampled-out lines
+#define REQUEST_LOG_REPORT_SECONDS 60
+
+namespace
+{
+// Ring of the calling thread, released to the writer thread when the thread ends
+struct ThreadRing
+{
+    std::shared_ptr<void> ring;
+    std::atomic<bool> *orphaned = nullptr;
+
+    ~ThreadRing()
+    {
+        if (orphaned)
+            orphaned->store(true, std::memory_order_release);
+    }
+};
+
+thread_local ThreadRing t_ring;
+} // namespace
+
+RequestLog::~RequestLog()
+{
+    stop();
+}
+
+void RequestLog::start(const Settings &settings)
+{
+    m_settings = settings;
+    if (m_settings.infoSampleRate == 0)
+        m_settings.infoSampleRate = 1;
+    if (m_settings.flushIntervalMS == 0)
+        m_settings.flushIntervalMS = 1;
+
+    if (!m_settings.buffered)
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Request log not buffered (read requests INFO sample rate: 1/%u)", m_settings.infoSampleRate);
+        return;
+    }
+
+    m_running = true;
+    m_thread = std::thread(&RequestLog::run, this);
+    m_buffered.store(true, std::memory_order_release);
+
+    APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Buffered request log started (read requests INFO sample rate: 1/%u, flush interval: %ums)", m_settings.infoSampleRate, m_settings.flushIntervalMS);
+}
+
+void RequestLog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_buffered.store(false, std::memory_order_release);
+    m_cond.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // Lines committed after the last drain of the writer thread (by requests that were appending
+    // when buffering stopped). The writer thread is gone, so this thread is the only reader.
+    drain();
+}
+
+uint64_t RequestLog::droppedLines() const
+{
+    uint64_t n = m_retiredDropped.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (const auto &ring : m_rings)
+        n += ring->dropped.load(std::memory_order_relaxed);
+    return n;
+}
+
+uint64_t RequestLog::sampledLines() const
+{
+    return m_sampled.load(std::memory_order_relaxed);
+}
+
+void RequestLog::setArg(Arg &arg, const char *value)
+{
+    arg.type = Arg::STRING;
+    arg.s.assign(value ? value : "(null)");
+}
+
+void RequestLog::setArg(Arg &arg, const std::string &value)
+{
+    arg.type = Arg::STRING;
+    arg.s.assign(value);
+}
+
+RequestLog::Ring &RequestLog::threadRing()
+{
+    if (!t_ring.ring)
+    {
+        auto ring = std::make_shared<Ring>();
+        t_ring.ring = ring;
+        t_ring.orphaned = &ring->orphaned;
+
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        m_rings.push_back(ring);
+    }
+    return *static_cast<Ring *>(t_ring.ring.get());
+}
+
+bool RequestLog::keep(Logs::eLogLevels level, bool sampleable)
+{
+    if (!m_settings.debug && (level == Logs::LEVEL_DEBUG || level == Logs::LEVEL_DEBUG1))
+        return false;
+
+    // One counter for all the threads: every thread (connection) doesn't start with a written line.
+    if (sampleable && level == Logs::LEVEL_INFO && m_settings.infoSampleRate > 1 && m_infoLines.fetch_add(1, std::memory_order_relaxed) % m_settings.infoSampleRate != 0)
+    {
+        m_sampled.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+RequestLog::Entry *RequestLog::reserve(bool sampleable, Entry &direct)
+{
+    Ring &ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= REQUEST_LOG_RING_SIZE)
+    {
+        if (!sampleable)
+            return &direct;
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return &ring.entries[head % REQUEST_LOG_RING_SIZE];
+}
+
+void RequestLog::commit()
+{
+    Ring &ring = threadRing();
+    ring.head.store(ring.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+std::string RequestLog::format(const Entry &entry)
+{
+    // The format is applied one conversion at a time, each with its own (typed) argument.
+    std::string out;
+    size_t arg = 0;
+    char buf[512];
+
+    for (const char *p = entry.format; *p; p++)
+    {
+        if (*p != '%')
+        {
+            out += *p;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out += '%';
+            p++;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        std::string spec = "%";
+        p++;
+        while (*p && strchr("-+ #0123456789.*", *p))
+            spec += *p++;
+        while (*p && strchr("hlLqjzt", *p))
+            p++;
+        if (!*p)
+            break;
+        char conversion = *p;
+
+        if (arg >= entry.argc)
+        {
+            out += "(missing)";
+            continue;
+        }
+        const Arg &a = entry.args[arg++];
+
+        if (conversion == 's' || a.type == Arg::STRING)
+        {
+            if (a.type == Arg::STRING)
+                snprintf(buf, sizeof(buf), (spec + "s").c_str(), a.s.c_str());
+            else if (a.type == Arg::DOUBLE)
+                snprintf(buf, sizeof(buf), "%g", a.d);
+            else if (a.type == Arg::UINT)
+                snprintf(buf, sizeof(buf), "%llu", a.u);
+            else
+                snprintf(buf, sizeof(buf), "%lld", a.i);
+        }
+        else if (strchr("eEfFgGaA", conversion))
+            snprintf(buf, sizeof(buf), (spec + conversion).c_str(), a.type == Arg::DOUBLE ? a.d : a.type == Arg::UINT ? static_cast<double>(a.u) : static_cast<double>(a.i));
+        else if (a.type == Arg::DOUBLE)
+            snprintf(buf, sizeof(buf), "%g", a.d);
+        else if (conversion == 'c')
+            snprintf(buf, sizeof(buf), (spec + 'c').c_str(), static_cast<int>(a.type == Arg::UINT ? a.u : static_cast<unsigned long long>(a.i)));
+        else
+            snprintf(buf, sizeof(buf), (spec + "ll" + conversion).c_str(), a.type == Arg::UINT ? a.u : static_cast<unsigned long long>(a.i));
+        out += buf;
+    }
+    return out;
+}
+
+void RequestLog::write(const Entry &entry)
+{
+    APP_LOG->log2(entry.function, entry.user, entry.ipAddress, entry.level, "%s", format(entry).c_str());
+}
+
+void RequestLog::drain()
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        rings = m_rings;
+    }
+
+    std::vector<Ring *> finished;
+    for (const auto &ring : rings)
+    {
+        // Read before the head: an orphaned ring gets no more entries after it.
+        bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++)
+        {
+            write(ring->entries[tail % REQUEST_LOG_RING_SIZE]);
+            ring->tail.store(tail + 1, std::memory_order_release);
+        }
+
+        if (orphaned)
+            finished.push_back(ring.get());
+    }
+
+    if (finished.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (Ring *ring : finished)
+    {
+        m_retiredDropped.fetch_add(ring->dropped.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_rings.erase(std::find_if(m_rings.begin(), m_rings.end(), [ring](const std::shared_ptr<Ring> &r) { return r.get() == ring; }));
+    }
+}
+
+void RequestLog::run()
+{
+    auto reportedAt = std::chrono::steady_clock::now();
+    uint64_t reportedDropped = 0, reportedSampled = 0;
+
+    for (;;)
+    {
+        bool running;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait_for(lock, std::chrono::milliseconds(m_settings.flushIntervalMS), [this] { return !m_running; });
+            running = m_running;
+        }
+
+        drain();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - reportedAt >= std::chrono::seconds(REQUEST_LOG_REPORT_SECONDS) || !running)
+        {
+            uint64_t dropped = droppedLines(), sampled = sampledLines();
+            if (dropped != reportedDropped || sampled != reportedSampled)
+            {
+                APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Request log: %lu line(s) dropped (buffer full), %lu INFO line(s) sampled out", static_cast<unsigned long>(dropped - reportedDropped),
+                              static_cast<unsigned long>(sampled - reportedSampled));
+                reportedDropped = dropped;
+                reportedSampled = sampled;
+            }
+            reportedAt = now;
+        }
+
+        if (!running)
+            return;
+    }
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <Mantids30/Config_Builder/program_logs.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Lines buffered per thread (see RequestLog for a full buffer)
+#define REQUEST_LOG_RING_SIZE 256
+// printf arguments kept per line
+#define REQUEST_LOG_MAX_ARGS 4
+
+/**
+ * @brief Request log lines of the endpoint handlers, kept out of the request path
+ *
+ * When buffered, every thread appends its lines (format string, arguments, user and address,
+ * without formatting them) to its own single-producer ring buffer, and a background thread
+ * formats and writes them to the application log. When the buffer of a thread is full, the lines
+ * of the read requests (logRead()) are dropped and the other lines (e.g. changes) are written
+ * right away by the calling thread (ahead of its buffered lines).
+ *
+ * When not buffered, lines go straight to the application log.
+ *
+ * In both modes the INFO lines of the read requests can be sampled (one of every N, counted over
+ * all the threads), the other lines are always kept. The dropped and sampled-out lines are
+ * counted, logged periodically and exposed by GET /api/v1/metrics.
+ */
+class RequestLog
+{
+public:
+    struct Settings
+    {
+        // Buffer the lines (and start the writer thread), or write them from the request thread
+        bool buffered = true;
+        // Write the INFO lines of logRead() for one of every N read requests (1: all of them)
+        uint32_t infoSampleRate = 1;
+        // Time between two writes of the buffered lines
+        uint32_t flushIntervalMS = 100;
+        // Keep DEBUG lines (otherwise dropped before buffering)
+        bool debug = false;
+    };
+
+    RequestLog() = default;
+    RequestLog(const RequestLog &) = delete;
+    RequestLog &operator=(const RequestLog &) = delete;
+    ~RequestLog();
+
+    /**
+     * @brief Apply the settings, and start buffering (and the writer thread) if buffered
+     */
+    void start(const Settings &settings);
+
+    /**
+     * @brief Stop buffering and write the buffered lines
+     */
+    void stop();
+
+    /**
+     * @brief Log a request line (printf format, integer/floating/string arguments), never sampled out
+     * @param function must be a string literal (e.g. __func__), like the format
+     */
+    template <typename... Args>
+    void log(const char *function, const std::string &user, const std::string &ipAddress, Mantids30::Program::Logs::eLogLevels level, const char *format, const Args &...args)
+    {
+        append(false, function, user, ipAddress, level, format, args...);
+    }
+
+    /**
+     * @brief Same as log(), for the requests that only read: INFO lines are subject to the sample rate
+     */
+    template <typename... Args>
+    void logRead(const char *function, const std::string &user, const std::string &ipAddress, Mantids30::Program::Logs::eLogLevels level, const char *format, const Args &...args)
+    {
+        append(true, function, user, ipAddress, level, format, args...);
+    }
+
+    uint64_t droppedLines() const;
+    uint64_t sampledLines() const;
+
+private:
+    template <typename... Args>
+    void append(bool sampleable, const char *function, const std::string &user, const std::string &ipAddress, Mantids30::Program::Logs::eLogLevels level, const char *format, const Args &...args)
+    {
+        static_assert(sizeof...(Args) <= REQUEST_LOG_MAX_ARGS, "Too many arguments for a request log line");
+
+        if (!keep(level, sampleable))
+            return;
+
+        // Not buffered (or full buffer): the line is formatted and written right away.
+        Entry direct;
+        Entry *entry = m_buffered.load(std::memory_order_acquire) ? reserve(sampleable, direct) : &direct;
+        if (!entry)
+            return;
+
+        entry->function = function;
+        entry->level = level;
+        entry->user = user;
+        entry->ipAddress = ipAddress;
+        entry->format = format;
+        entry->argc = 0;
+        (setArg(entry->args[entry->argc++], args), ...);
+
+        if (entry == &direct)
+            write(direct);
+        else
+            commit();
+    }
+
+    struct Arg
+    {
+        enum Type
+        {
+            INT,
+            UINT,
+            DOUBLE,
+            STRING
+        } type = INT;
+        long long i = 0;
+        unsigned long long u = 0;
+        double d = 0;
+        std::string s;
+    };
+
+    struct Entry
+    {
+        const char *function = nullptr;
+        Mantids30::Program::Logs::eLogLevels level;
+        std::string user;
+        std::string ipAddress;
+        const char *format = nullptr;
+        size_t argc = 0;
+        std::array<Arg, REQUEST_LOG_MAX_ARGS> args;
+    };
+
+    struct Ring
+    {
+        std::array<Entry, REQUEST_LOG_RING_SIZE> entries;
+        // Next entry to write (producer) and to read (writer thread)
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+        // Set when the producer thread ends
+        std::atomic<bool> orphaned{false};
+
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    static void setArg(Arg &arg, const char *value);
+    static void setArg(Arg &arg, const std::string &value);
+    template <typename T>
+    static std::enable_if_t<std::is_arithmetic_v<T>> setArg(Arg &arg, T value)
+    {
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            arg.type = Arg::DOUBLE;
+            arg.d = value;
+        }
+        else if constexpr (std::is_signed_v<T>)
+        {
+            arg.type = Arg::INT;
+            arg.i = value;
+        }
+        else
+        {
+            arg.type = Arg::UINT;
+            arg.u = value;
+        }
+    }
+
+    /**
+     * @brief Whether the line is written at all (level, sample rate)
+     * @param sampleable the line comes from logRead()
+     */
+    bool keep(Mantids30::Program::Logs::eLogLevels level, bool sampleable);
+
+    /**
+     * @brief Entry of the ring of the calling thread to fill. When the ring is full: nullptr for a
+     * line of logRead() (dropped), otherwise the direct entry (written by the calling thread).
+     */
+    Entry *reserve(bool sampleable, Entry &direct);
+    void commit();
+    Ring &threadRing();
+
+    static std::string format(const Entry &entry);
+    static void write(const Entry &entry);
+
+    void run();
+    void drain();
+
+    Settings m_settings;
+    std::atomic<bool> m_buffered{false};
+
+    mutable std::mutex m_ringsMutex;
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    // INFO lines of logRead() seen by keep() (sample rate), sampled out
+    std::atomic<uint64_t> m_infoLines{0};
+    std::atomic<uint64_t> m_sampled{0};
+    // Dropped lines of the rings already removed
+    std::atomic<uint64_t> m_retiredDropped{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_running = false;
+    std::thread m_thread;
+};
@@ -23,7 +23,9 @@
 #include <boost/algorithm/string/case_conv.hpp>
 #include "dbinit.h"
 #include "definitions/accesscontrol.h"
+#include <algorithm>
 #include <optional>
+#include <thread>
 
 using namespace Mantids30;
 using namespace Mantids30::Program;
@@ -74,6 +76,13 @@ bool startWebService()
 
     vars["APP"] = std::string(appName);
 
+    // Thread pool mode: PoolSize 0 (or unset) runs one worker per CPU core
+    if (webConfig->get<bool>("Threads.UseThreadPool", false) && webConfig->get<uint32_t>("Threads.PoolSize", 0) == 0)
+    {
+        webConfig->put("Threads.PoolSize", std::max(1u, std::thread::hardware_concurrency()));
+        APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Web service thread pool: %u worker(s)", webConfig->get<uint32_t>("Threads.PoolSize"));
+    }
+
     // Create RESTful engine with secure defaults
     auto *engine = Config::RESTful_Engine::createRESTfulEngine(*webConfig,
                                                                APP_LOG,
@@ -102,6 +111,12 @@ bool startWebService()
     engine->config.appName = vars["APP"];
     engine->config.setSoftwareVersion(atoi(PROJECT_VER_MAJOR), atoi(PROJECT_VER_MINOR), atoi(PROJECT_VER_PATCH), "stable");
 
+    // The rate limits are resolved for every endpoint when it gets registered
+    if (auto rateLimits = g_ctx.config.get_child_optional("RateLimits"))
+    {
+        g_ctx.rateLimiter.setup(*rateLimits);
+    }
+
     // Register API v1 endpoints
     engine->endpointsHandler[1] = registerAPIEndpoints();
 
@@ -173,6 +188,16 @@ public:
 
         g_ctx.startTime = time(nullptr);
 
+        RequestLog::Settings requestLogSettings;
+        if (auto requestLog = g_ctx.config.get_child_optional("WebService.Logs.RequestLog"))
+        {
+            requestLogSettings.buffered = requestLog->get<bool>("Buffered", requestLogSettings.buffered);
+            requestLogSettings.infoSampleRate = requestLog->get<uint32_t>("InfoSampleRate", requestLogSettings.infoSampleRate);
+            requestLogSettings.flushIntervalMS = requestLog->get<uint32_t>("FlushIntervalMS", requestLogSettings.flushIntervalMS);
+        }
+        requestLogSettings.debug = g_ctx.config.get<bool>("Logs.Debug", false);
+        g_ctx.requestLog.start(requestLogSettings);
+
         if (!initDatabase())
         {
             return EXIT_FAILURE;
@@ -184,6 +209,13 @@ public:
             exit(EXIT_FAILURE);
         }
 
+        // Every endpoint is registered by now.
+        std::string metricsFile = g_ctx.config.get<std::string>("Metrics.TextFile", "");
+        if (!metricsFile.empty())
+        {
+            g_ctx.metrics.startTextFile(metricsFile, g_ctx.config.get<uint32_t>("Metrics.TextFileIntervalSeconds", 15));
+        }
+
         APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Service ready");
         return EXIT_SUCCESS;
     }
@@ -191,7 +223,14 @@ public:
     /**
      * @brief Clean shutdown handler
      */
-    void _shutdown() override { APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Shutting down..."); }
+    void _shutdown() override
+    {
+        APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Shutting down...");
+        g_ctx.metrics.stop();
+        g_ctx.dbMaintenance.stop();
+        g_ctx.dbWriteQueue.stop();
+        g_ctx.requestLog.stop();
+    }
 };
 
 // ============================================================================
@@ -0,0 +1,84 @@
+#include "histogram.h"
+
+#include <cmath>
+
+// Threads get their shard in order of arrival.
+static size_t threadShard()
+{
+    static std::atomic<size_t> nextShard{0};
+    thread_local size_t shard = nextShard.fetch_add(1, std::memory_order_relaxed) % HISTOGRAM_SHARDS;
+    return shard;
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t micros)
+{
+    if (micros < LINEAR_BUCKETS)
+        return micros;
+
+    unsigned exponent = 63 - __builtin_clzll(micros);
+    if (exponent > MAX_EXPONENT)
+        return BUCKETS - 1;
+
+    // The 2 bits after the leading one select the sub-bucket.
+    return LINEAR_BUCKETS + (exponent - 3) * 4 + ((micros >> (exponent - 2)) & 3);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t bucket)
+{
+    if (bucket < LINEAR_BUCKETS)
+        return bucket + 1;
+
+    unsigned exponent = 3 + (bucket - LINEAR_BUCKETS) / 4;
+    uint64_t subBucket = (bucket - LINEAR_BUCKETS) % 4;
+    return (4 + subBucket + 1) << (exponent - 2);
+}
+
+void LatencyHistogram::record(uint64_t micros)
+{
+    Shard &shard = m_shards[threadShard()];
+    shard.buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    shard.sumMicros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snapshot;
+    for (const Shard &shard : m_shards)
+    {
+        for (size_t i = 0; i < BUCKETS; i++)
+            snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        snapshot.sumMicros += shard.sumMicros.load(std::memory_order_relaxed);
+    }
+
+    // The count is taken from the buckets so the snapshot stays consistent with itself.
+    for (uint64_t n : snapshot.buckets)
+        snapshot.count += n;
+    return snapshot;
+}
+
+uint64_t LatencyHistogram::Snapshot::quantile(double q) const
+{
+    if (count == 0)
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return bucketUpperBound(i);
+    }
+    return bucketUpperBound(BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::Snapshot::countUpTo(uint64_t micros) const
+{
+    uint64_t n = 0;
+    for (size_t i = 0; i < BUCKETS && bucketUpperBound(i) <= micros + 1; i++)
+        n += buckets[i];
+    return n;
+}
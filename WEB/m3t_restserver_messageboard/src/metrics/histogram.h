@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Shards written by different threads (a thread always writes to the same shard)
+#define HISTOGRAM_SHARDS 8
+
+/**
+ * @brief Lock-free latency histogram with log-linear (HDR-style) buckets
+ *
+ * Values are microseconds: exact below 8us, then 4 buckets per power of two (at most ~19% wide)
+ * up to 2^36us. Writers only do relaxed atomic increments on the cache-line aligned shard of
+ * their thread, readers merge all the shards into a snapshot.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr size_t LINEAR_BUCKETS = 8;
+    static constexpr unsigned MAX_EXPONENT = 35;
+    static constexpr size_t BUCKETS = LINEAR_BUCKETS + (MAX_EXPONENT - 2) * 4;
+
+    struct Snapshot
+    {
+        std::array<uint64_t, BUCKETS> buckets{};
+        uint64_t count = 0;
+        uint64_t sumMicros = 0;
+
+        /**
+         * @brief Upper bound (microseconds) of the value at the given quantile (0..1)
+         */
+        uint64_t quantile(double q) const;
+
+        /**
+         * @brief Number of values that are known to be <= micros (whole buckets only)
+         */
+        uint64_t countUpTo(uint64_t micros) const;
+    };
+
+    void record(uint64_t micros);
+    Snapshot snapshot() const;
+
+    /**
+     * @brief First value (microseconds) above the bucket
+     */
+    static uint64_t bucketUpperBound(size_t bucket);
+
+private:
+    static size_t bucketOf(uint64_t micros);
+
+    struct alignas(64) Shard
+    {
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+        std::atomic<uint64_t> sumMicros{0};
+    };
+
+    std::array<Shard, HISTOGRAM_SHARDS> m_shards;
+};
@@ -0,0 +1,4 @@
+#pragma once
+
+// Response counters are kept for HTTP status codes below this value (server metrics and load generator)
+#define METRICS_MAX_HTTP_STATUS 600
@@ -0,0 +1,224 @@
+#include "metrics.h"
+
+#include "../definitions/context.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace Mantids30;
+
+// Database time of the request being handled by this thread
+struct RequestPhases
+{
+    Metrics::Clock::duration dbWait{};
+    Metrics::Clock::duration sql{};
+    // Set when the request is in the serialization sample, until its response is timed
+    bool sampleSerialization = false;
+    bool serialized = false;
+    Metrics::Clock::duration serialization{};
+};
+
+static thread_local RequestPhases t_phases;
+
+// Histogram buckets exposed to Prometheus (seconds)
+static const double BUCKET_BOUNDS[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+static uint64_t toMicros(Metrics::Clock::duration elapsed)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+static std::string seconds(uint64_t micros)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6f", static_cast<double>(micros) / 1e6);
+    return buf;
+}
+
+Metrics::~Metrics()
+{
+    stop();
+}
+
+void *Metrics::instrument(const std::string &method, const std::string &path, API::RESTful::MethodType handler, void *context)
+{
+    Endpoint &endpoint = m_endpoints.emplace_back();
+    endpoint.method = method;
+    endpoint.path = path;
+    endpoint.handler = handler;
+    endpoint.context = context;
+    return &endpoint;
+}
+
+API::APIReturn Metrics::handle(void *context, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+{
+    Endpoint *endpoint = static_cast<Endpoint *>(context);
+
+    t_phases = RequestPhases();
+    t_phases.sampleSerialization = endpoint->calls.fetch_add(1, std::memory_order_relaxed) % METRICS_SERIALIZATION_SAMPLE_RATE == 0;
+    Clock::time_point start = Clock::now();
+    API::APIReturn result = endpoint->handler(endpoint->context, params, clientDetails);
+    endpoint->total.record(toMicros(Clock::now() - start));
+    endpoint->dbWait.record(toMicros(t_phases.dbWait));
+    endpoint->sql.record(toMicros(t_phases.sql));
+    if (t_phases.serialized)
+        endpoint->serialization.record(toMicros(t_phases.serialization));
+
+    size_t status = static_cast<size_t>(result.getHTTPResponseCode());
+    if (status < METRICS_MAX_HTTP_STATUS)
+        endpoint->responses[status].fetch_add(1, std::memory_order_relaxed);
+    return result;
+}
+
+void Metrics::addDBWait(Clock::duration elapsed)
+{
+    t_phases.dbWait += elapsed;
+}
+
+void Metrics::addSQL(Clock::duration elapsed)
+{
+    t_phases.sql += elapsed;
+}
+
+void Metrics::measureSerialization(const Json::Value &response)
+{
+    if (!t_phases.sampleSerialization || t_phases.serialized)
+        return;
+
+    static const Json::StreamWriterBuilder writer = []
+    {
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        return builder;
+    }();
+
+    Clock::time_point start = Clock::now();
+    std::string body = Json::writeString(writer, response);
+    t_phases.serialization = Clock::now() - start;
+    t_phases.serialized = true;
+}
+
+void Metrics::addCounter(const std::string &name, const std::string &help, std::function<uint64_t()> read)
+{
+    m_values.push_back(Value{name, help, "counter", std::move(read)});
+}
+
+void Metrics::addGauge(const std::string &name, const std::string &help, std::function<uint64_t()> read)
+{
+    m_values.push_back(Value{name, help, "gauge", std::move(read)});
+}
+
+std::string Metrics::prometheusText() const
+{
+    std::ostringstream out;
+
+    auto histogram = [this, &out](const char *name, const char *help, LatencyHistogram Endpoint::*member)
+    {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " histogram\n";
+
+        std::ostringstream quantiles;
+        for (const Endpoint &endpoint : m_endpoints)
+        {
+            std::string labels = "method=\"" + endpoint.method + "\",path=\"" + endpoint.path + "\"";
+            LatencyHistogram::Snapshot snapshot = (endpoint.*member).snapshot();
+
+            // Values are counted under a bound only when their whole bucket is below it.
+            for (double bound : BUCKET_BOUNDS)
+                out << name << "_bucket{" << labels << ",le=\"" << bound << "\"} " << snapshot.countUpTo(static_cast<uint64_t>(bound * 1e6)) << "\n";
+            out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << snapshot.count << "\n";
+            out << name << "_sum{" << labels << "} " << seconds(snapshot.sumMicros) << "\n";
+            out << name << "_count{" << labels << "} " << snapshot.count << "\n";
+
+            for (const char *q : {"0.5", "0.99", "0.999"})
+                quantiles << name << "_quantile{" << labels << ",quantile=\"" << q << "\"} " << seconds(snapshot.quantile(std::stod(q))) << "\n";
+        }
+
+        out << "# HELP " << name << "_quantile " << help << " (upper bound of the quantile)\n";
+        out << "# TYPE " << name << "_quantile gauge\n";
+        out << quantiles.str();
+    };
+
+    histogram("mboard_request_duration_seconds", "Time spent in the endpoint handler", &Endpoint::total);
+    histogram("mboard_request_db_wait_seconds", "Time spent waiting for a database connection or the write queue", &Endpoint::dbWait);
+    histogram("mboard_request_sql_seconds", "Time spent running SQL and reading its results", &Endpoint::sql);
+    histogram("mboard_response_serialization_seconds", "Time spent serializing the JSON response (sampled, read requests only)", &Endpoint::serialization);
+
+    out << "# HELP mboard_responses_total Responses by HTTP status\n";
+    out << "# TYPE mboard_responses_total counter\n";
+    for (const Endpoint &endpoint : m_endpoints)
+    {
+        for (size_t status = 0; status < METRICS_MAX_HTTP_STATUS; status++)
+        {
+            uint64_t n = endpoint.responses[status].load(std::memory_order_relaxed);
+            if (n)
+                out << "mboard_responses_total{method=\"" << endpoint.method << "\",path=\"" << endpoint.path << "\",status=\"" << status << "\"} " << n << "\n";
+        }
+    }
+
+    for (const Value &value : m_values)
+    {
+        out << "# HELP " << value.name << " " << value.help << "\n";
+        out << "# TYPE " << value.name << " " << value.type << "\n";
+        out << value.name << " " << value.read() << "\n";
+    }
+
+    return out.str();
+}
+
+void Metrics::startTextFile(const std::string &path, uint32_t intervalSeconds)
+{
+    m_textFile = path;
+    m_textFileIntervalSeconds = std::max(1u, intervalSeconds);
+
+    m_running = true;
+    m_thread = std::thread(&Metrics::runTextFile, this);
+
+    APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Writing the metrics to '%s' every %us", m_textFile.c_str(), m_textFileIntervalSeconds);
+}
+
+void Metrics::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void Metrics::runTextFile()
+{
+    bool failed = false;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    do
+    {
+        lock.unlock();
+        // Logged once until it works again.
+        bool ok = writeTextFile();
+        if (!ok && !failed)
+            APP_LOG->log0(__func__, Logs::LEVEL_ERR, "Failed to write the metrics to '%s'", m_textFile.c_str());
+        failed = !ok;
+        lock.lock();
+    } while (!m_cond.wait_for(lock, std::chrono::seconds(m_textFileIntervalSeconds), [this] { return !m_running; }));
+}
+
+bool Metrics::writeTextFile() const
+{
+    // Written aside and renamed: a scrape never reads a partial file.
+    std::string tmpPath = m_textFile + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (!file.is_open())
+            return false;
+        file << prometheusText();
+        if (!file.flush())
+            return false;
+    }
+    return std::rename(tmpPath.c_str(), m_textFile.c_str()) == 0;
+}
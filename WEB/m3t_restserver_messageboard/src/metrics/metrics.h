@@ -0,0 +1,134 @@
+#pragma once
+
+#include "histogram.h"
+#include "httpstatus.h"
+
+#include <Mantids30/Server_RESTfulWebAPI/engine.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// One of every N responses of an endpoint has its serialization timed
+#define METRICS_SERIALIZATION_SAMPLE_RATE 16
+
+/**
+ * @brief Per-endpoint request metrics
+ *
+ * Every endpoint is registered through instrument(): the web server calls handle() with the
+ * instrumented endpoint as context, which runs the real handler and records its latency, the
+ * time spent waiting for a database connection (reader pool or write queue), the time spent
+ * holding it (running SQL and reading the rows) and the HTTP status of the response.
+ *
+ * The JSON response is serialized by the web server after the handler returns, out of reach from
+ * here: handlers pass their response to measureSerialization(), which serializes a sample of them
+ * once more to time it. Write responses are built by the writer thread and are not timed.
+ *
+ * The API only answers JSON behind the JWT cookie authentication, so GET /api/v1/metrics can't be
+ * scraped by Prometheus. The same text is written to a file for the textfile collector of
+ * node_exporter instead (see startTextFile).
+ *
+ * Recording is lock-free (see LatencyHistogram), the registry is only modified at startup.
+ */
+class Metrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Endpoint
+    {
+        std::string method;
+        std::string path;
+        Mantids30::API::RESTful::MethodType handler = nullptr;
+        void *context = nullptr;
+
+        LatencyHistogram total;
+        LatencyHistogram dbWait;
+        LatencyHistogram sql;
+        LatencyHistogram serialization;
+        std::array<std::atomic<uint64_t>, METRICS_MAX_HTTP_STATUS> responses{};
+        std::atomic<uint64_t> calls{0};
+    };
+
+    Metrics() = default;
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+    ~Metrics();
+
+    /**
+     * @brief Register an endpoint
+     * @param context passed to the handler
+     * @return context to be registered with handle() as the endpoint method
+     */
+    void *instrument(const std::string &method, const std::string &path, Mantids30::API::RESTful::MethodType handler, void *context = nullptr);
+
+    /**
+     * @brief Endpoint method of every instrumented endpoint
+     */
+    static Mantids30::API::APIReturn handle(void *context, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+
+    /**
+     * @brief Account database time to the request running in the calling thread
+     */
+    static void addDBWait(Clock::duration elapsed);
+    static void addSQL(Clock::duration elapsed);
+
+    /**
+     * @brief Time the serialization of the response of the request running in the calling thread
+     * (only when the request is in the sample, see METRICS_SERIALIZATION_SAMPLE_RATE)
+     */
+    static void measureSerialization(const Json::Value &response);
+
+    /**
+     * @brief Register a counter/gauge kept elsewhere, read when the metrics are exported
+     */
+    void addCounter(const std::string &name, const std::string &help, std::function<uint64_t()> read);
+    void addGauge(const std::string &name, const std::string &help, std::function<uint64_t()> read);
+
+    /**
+     * @brief Metrics of every endpoint in the Prometheus text exposition format
+     */
+    std::string prometheusText() const;
+
+    /**
+     * @brief Start writing prometheusText() to the file every intervalSeconds (after the endpoints
+     * are registered). The file is replaced atomically, as the textfile collector requires.
+     */
+    void startTextFile(const std::string &path, uint32_t intervalSeconds);
+
+    /**
+     * @brief Stop writing the file
+     */
+    void stop();
+
+private:
+    void runTextFile();
+    bool writeTextFile() const;
+
+    // std::deque keeps the endpoints (the handler contexts) in place while new ones are added
+    std::deque<Endpoint> m_endpoints;
+
+    struct Value
+    {
+        std::string name;
+        std::string help;
+        const char *type;
+        std::function<uint64_t()> read;
+    };
+    std::deque<Value> m_values;
+
+    std::string m_textFile;
+    uint32_t m_textFileIntervalSeconds = 15;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_running = false;
+    std::thread m_thread;
+};
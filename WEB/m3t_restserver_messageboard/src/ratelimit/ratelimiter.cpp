@@ -0,0 +1,199 @@
+#include "ratelimiter.h"
+
+#include "../definitions/context.h"
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <functional>
+
+using namespace Mantids30;
+using namespace Mantids30::Network::Protocols;
+
+RateLimiter::Rule RateLimiter::parseRule(const std::string &name, const boost::property_tree::ptree &config, const Rule &base)
+{
+    auto parseLimit = [&config](const std::string &key, const Limit &baseLimit)
+    {
+        Limit limit;
+        limit.rate = std::max(0.0, config.get<double>(key + ".Rate", baseLimit.rate));
+        // A bucket holds at least one token (and defaults to one second of requests).
+        limit.burst = std::max(1.0, config.get<double>(key + ".Burst", config.count(key) ? limit.rate : baseLimit.burst));
+        return limit;
+    };
+
+    Rule rule;
+    rule.name = name;
+    rule.perIP = parseLimit("PerIP", base.perIP);
+    rule.perUser = parseLimit("PerUser", base.perUser);
+    return rule;
+}
+
+void RateLimiter::setup(const boost::property_tree::ptree &config)
+{
+    m_enabled = config.get<bool>("Enabled", true);
+    m_idleTimeout = std::chrono::seconds(std::max(1u, config.get<uint32_t>("IdleSeconds", 600)));
+    // A request may need RATE_LIMITER_MAX_TAKES buckets of the same shard at once.
+    m_maxBucketsPerShard = std::max<size_t>(RATE_LIMITER_MAX_TAKES, config.get<size_t>("MaxBuckets", 100000) / RATE_LIMITER_SHARDS);
+
+    // Scope and endpoint rules only limit what they define (unlimited otherwise).
+    Rule unlimited;
+    if (auto defaults = config.get_child_optional("Default"))
+        m_defaultRule = parseRule("default", *defaults, unlimited);
+    if (auto scopes = config.get_child_optional("Scopes"))
+    {
+        for (const auto &i : *scopes)
+            m_scopeRules[i.first] = parseRule("scope:" + i.first, i.second, unlimited);
+    }
+    if (auto endpoints = config.get_child_optional("Endpoints"))
+    {
+        for (const auto &i : *endpoints)
+            m_endpointRules[i.first] = parseRule("endpoint:" + i.first, i.second, unlimited);
+    }
+
+    APP_LOG->log0(__func__, Logs::LEVEL_INFO, "Rate limiting %s: %zu scope rule(s), %zu endpoint rule(s)", m_enabled ? "enabled" : "disabled", m_scopeRules.size(), m_endpointRules.size());
+}
+
+void *RateLimiter::protect(const std::string &method, const std::string &path, const std::set<std::string> &scopes, API::RESTful::MethodType handler)
+{
+    Endpoint &endpoint = m_endpoints.emplace_back();
+    endpoint.limiter = this;
+    endpoint.handler = handler;
+
+    auto rule = m_endpointRules.find(method + " " + path);
+    if (rule != m_endpointRules.end())
+    {
+        endpoint.rule = &rule->second;
+        return &endpoint;
+    }
+    for (const std::string &scope : scopes)
+    {
+        rule = m_scopeRules.find(scope);
+        if (rule != m_scopeRules.end())
+        {
+            endpoint.rule = &rule->second;
+            break;
+        }
+    }
+    return &endpoint;
+}
+
+API::APIReturn RateLimiter::handle(void *context, const API::RESTful::RequestParameters &params, Sessions::ClientDetails &clientDetails)
+{
+    Endpoint *endpoint = static_cast<Endpoint *>(context);
+    RateLimiter *limiter = endpoint->limiter;
+
+    if (limiter->m_enabled)
+    {
+        std::string user = params.jwtToken->getSubject();
+
+        std::array<Take, RATE_LIMITER_MAX_TAKES> takes;
+        size_t count = 0;
+        if (endpoint->rule)
+            limiter->addTakes(*endpoint->rule, clientDetails.ipAddress, user, takes, count);
+        limiter->addTakes(limiter->m_defaultRule, clientDetails.ipAddress, user, takes, count);
+
+        Clock::duration retryIn = Clock::duration::zero();
+        if (count && !limiter->take(takes, count, Clock::now(), retryIn))
+        {
+            long long retryMS = std::chrono::duration_cast<std::chrono::milliseconds>(retryIn).count() + 1;
+            // Handlers can't set response headers: the Retry-After value (seconds, rounded up) goes in the message.
+            long long retryAfter = (retryMS + 999) / 1000;
+            g_ctx.requestLog.log(__func__, user, clientDetails.ipAddress, Logs::LEVEL_DEBUG, "Request rate limited, retry in %lldms", retryMS);
+            return API::APIReturn(HTTP::Status::S_429_TOO_MANY_REQUESTS, "rate_limited",
+                                  "Too many requests, retry in " + std::to_string(retryMS) + "ms (Retry-After: " + std::to_string(retryAfter) + ")");
+        }
+    }
+
+    return endpoint->handler(nullptr, params, clientDetails);
+}
+
+void RateLimiter::addTakes(const Rule &rule, const std::string &ipAddress, const std::string &user, std::array<Take, RATE_LIMITER_MAX_TAKES> &takes, size_t &count)
+{
+    auto add = [this, &takes, &count](std::string key, const Limit &limit)
+    {
+        Take &take = takes[count++];
+        take.key = std::move(key);
+        take.limit = &limit;
+        take.shard = &m_shards[std::hash<std::string>()(take.key) % RATE_LIMITER_SHARDS];
+    };
+
+    if (rule.perIP.rate > 0 && !ipAddress.empty())
+        add(rule.name + "|ip|" + ipAddress, rule.perIP);
+    if (rule.perUser.rate > 0 && !user.empty())
+        add(rule.name + "|user|" + user, rule.perUser);
+}
+
+bool RateLimiter::take(std::array<Take, RATE_LIMITER_MAX_TAKES> &takes, size_t count, Clock::time_point now, Clock::duration &retryIn)
+{
+    // The shards of all the buckets are held together, locked in address order (no deadlock
+    // between requests sharing shards).
+    std::array<Shard *, RATE_LIMITER_MAX_TAKES> shards;
+    for (size_t i = 0; i < count; i++)
+        shards[i] = takes[i].shard;
+    std::sort(shards.begin(), shards.begin() + count);
+    size_t shardCount = static_cast<size_t>(std::unique(shards.begin(), shards.begin() + count) - shards.begin());
+
+    std::array<std::unique_lock<std::mutex>, RATE_LIMITER_MAX_TAKES> locks;
+    for (size_t i = 0; i < shardCount; i++)
+        locks[i] = std::unique_lock<std::mutex>(shards[i]->mutex);
+
+    // Checked first, debited only if every bucket has a token.
+    std::array<Bucket *, RATE_LIMITER_MAX_TAKES> buckets;
+    bool allowed = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        buckets[i] = &bucket(*takes[i].shard, takes[i].key, *takes[i].limit, now);
+        if (buckets[i]->tokens < 1)
+        {
+            allowed = false;
+            retryIn = std::max(retryIn, std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((1 - buckets[i]->tokens) / takes[i].limit->rate)));
+        }
+    }
+
+    if (allowed)
+    {
+        for (size_t i = 0; i < count; i++)
+            buckets[i]->tokens -= 1;
+    }
+    return allowed;
+}
+
+RateLimiter::Bucket &RateLimiter::bucket(Shard &shard, const std::string &key, const Limit &limit, Clock::time_point now)
+{
+    // Idle buckets are full again: drop them (the least recently used come first).
+    while (!shard.lru.empty())
+    {
+        auto oldest = shard.buckets.find(*shard.lru.front());
+        if (now - oldest->second.updatedAt <= m_idleTimeout)
+            break;
+        shard.lru.pop_front();
+        shard.buckets.erase(oldest);
+    }
+
+    auto found = shard.buckets.find(key);
+    if (found != shard.buckets.end())
+    {
+        Bucket &bucket = found->second;
+        if (now > bucket.updatedAt)
+        {
+            double elapsed = std::chrono::duration<double>(now - bucket.updatedAt).count();
+            bucket.tokens = std::min(limit.burst, bucket.tokens + elapsed * limit.rate);
+            bucket.updatedAt = now;
+        }
+        shard.lru.splice(shard.lru.end(), shard.lru, bucket.lru);
+        return bucket;
+    }
+
+    // Table full: the least recently used bucket makes room (the buckets of the current request
+    // were just moved to the end, and a shard holds at least RATE_LIMITER_MAX_TAKES of them).
+    if (shard.buckets.size() >= m_maxBucketsPerShard)
+    {
+        shard.buckets.erase(shard.buckets.find(*shard.lru.front()));
+        shard.lru.pop_front();
+        m_evicted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto inserted = shard.buckets.emplace(key, Bucket{limit.burst, now, {}}).first;
+    inserted->second.lru = shard.lru.insert(shard.lru.end(), &inserted->first);
+    return inserted->second;
+}
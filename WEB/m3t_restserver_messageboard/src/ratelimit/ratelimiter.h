@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Mantids30/Server_RESTfulWebAPI/engine.h>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+// Independent parts of the bucket table (one mutex each)
+#define RATE_LIMITER_SHARDS 16
+// Buckets a request can take a token from (per IP and per user, of its rule and of the default rule)
+#define RATE_LIMITER_MAX_TAKES 4
+
+/**
+ * @brief Token-bucket rate limiting per client IP address and per user (JWT subject)
+ *
+ * Every request takes a token from the default buckets of its client (shared by all the
+ * endpoints) and from the buckets of the most specific rule of its endpoint: the endpoint rule,
+ * or else the rule of one of its required scopes (shared by the endpoints of that scope). The
+ * tokens are only taken when every bucket has one: a request without tokens takes none, and is
+ * answered with 429 before its handler runs, so it never reaches the database.
+ *
+ * Buckets are kept in a sharded hash table, in least recently used order. They are evicted once
+ * idle (an idle bucket is full again, so evicting it changes nothing), or when the table is full
+ * (MaxBuckets): the least recently used ones first, whose clients then start with a full bucket.
+ */
+class RateLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Limit
+    {
+        // Tokens per second (0: unlimited) and bucket size
+        double rate = 0;
+        double burst = 0;
+    };
+
+    struct Rule
+    {
+        std::string name;
+        Limit perIP;
+        Limit perUser;
+    };
+
+    RateLimiter() = default;
+    RateLimiter(const RateLimiter &) = delete;
+    RateLimiter &operator=(const RateLimiter &) = delete;
+
+    /**
+     * @brief Load the limits (RateLimits section of webserver.conf), before protecting the endpoints
+     */
+    void setup(const boost::property_tree::ptree &config);
+
+    /**
+     * @brief Resolve the rules of an endpoint
+     * @return context to be registered with handle() as the endpoint method
+     */
+    void *protect(const std::string &method, const std::string &path, const std::set<std::string> &scopes, Mantids30::API::RESTful::MethodType handler);
+
+    /**
+     * @brief Endpoint method of every protected endpoint: checks the limits, then runs the handler
+     */
+    static Mantids30::API::APIReturn handle(void *context, const Mantids30::API::RESTful::RequestParameters &params, Mantids30::Sessions::ClientDetails &clientDetails);
+
+    /**
+     * @brief Buckets evicted before being idle because the table was full
+     */
+    uint64_t evictedBuckets() const { return m_evicted.load(std::memory_order_relaxed); }
+
+private:
+    struct Endpoint
+    {
+        RateLimiter *limiter = nullptr;
+        Mantids30::API::RESTful::MethodType handler = nullptr;
+        // Scope or endpoint rule (nullptr: only the default one applies)
+        const Rule *rule = nullptr;
+    };
+
+    struct Bucket
+    {
+        double tokens;
+        Clock::time_point updatedAt;
+        // Position in the LRU list of the shard
+        std::list<const std::string *>::iterator lru;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, Bucket> buckets;
+        // Keys of the buckets, least recently used first
+        std::list<const std::string *> lru;
+    };
+
+    struct Take
+    {
+        std::string key;
+        const Limit *limit;
+        Shard *shard;
+    };
+
+    static Rule parseRule(const std::string &name, const boost::property_tree::ptree &config, const Rule &base);
+
+    /**
+     * @brief Add the buckets of the rule for the client to the takes
+     */
+    void addTakes(const Rule &rule, const std::string &ipAddress, const std::string &user, std::array<Take, RATE_LIMITER_MAX_TAKES> &takes, size_t &count);
+
+    /**
+     * @brief Take a token from every bucket, or from none of them
+     * @param retryIn time until every bucket has a token (when denied)
+     */
+    bool take(std::array<Take, RATE_LIMITER_MAX_TAKES> &takes, size_t count, Clock::time_point now, Clock::duration &retryIn);
+
+    /**
+     * @brief Bucket of the key, refilled until now (created full, the shard being locked)
+     */
+    Bucket &bucket(Shard &shard, const std::string &key, const Limit &limit, Clock::time_point now);
+
+    bool m_enabled = false;
+    Clock::duration m_idleTimeout = std::chrono::minutes(10);
+    size_t m_maxBucketsPerShard = 100000 / RATE_LIMITER_SHARDS;
+    std::atomic<uint64_t> m_evicted{0};
+
+    Rule m_defaultRule;
+    // Scope -> rule, "METHOD path" -> rule (std::map: the endpoints keep pointers to the rules)
+    std::map<std::string, Rule> m_scopeRules;
+    std::map<std::string, Rule> m_endpointRules;
+
+    std::deque<Endpoint> m_endpoints;
+    std::array<Shard, RATE_LIMITER_SHARDS> m_shards;
+};